@@ -0,0 +1,5 @@
+#version 330
+
+// The depth pre-pass writes no color (the color mask is off), only the depth of the fragments
+void main(){
+}
@@ -0,0 +1,23 @@
+#version 330
+
+// INSTANCED: the model matrix is read per instance (see "InstanceData" in "source/common/mesh/mesh.hpp")
+#pragma keywords INSTANCED
+
+// The depth pre-pass only needs the clip space position (see "ForwardRenderer::drawDepthPrepass")
+#include "include/camera.glsl"
+
+#ifdef INSTANCED
+layout(location = 4) in mat4 M;
+#else
+uniform mat4 M;
+#endif
+
+layout(location = 0) in vec3 position;
+
+// The color pass tests against this depth with GL_EQUAL, so the position must be computed exactly like in "lighted.vert"
+invariant gl_Position;
+
+void main() {
+    vec3 world = (M * vec4(position, 1.0)).xyz;
+    gl_Position = VP * vec4(world, 1.0);
+}
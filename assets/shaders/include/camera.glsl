@@ -0,0 +1,6 @@
+// The per-frame camera data is uploaded once per frame by the renderer (see "ForwardRenderer::render")
+// The layout must match "CameraBlock" in "source/common/systems/forward-renderer.hpp"
+layout(std140) uniform Camera {
+    mat4 VP;
+    vec3 eye;
+};
@@ -0,0 +1,95 @@
+// The light data shared by the lighted shaders (see "ForwardRenderer", "LightClusters" and "ShadowMaps")
+
+#define DIRECTIONAL 0
+#define POINT 1
+#define SPOT 2
+
+struct Light {
+    int type;
+    vec3 position;
+    vec3 direction;
+    vec3 diffuse;
+    vec3 specular;
+    vec3 attenuation; // x*d^2 + y*d + z
+    vec2 cone_angles; // x: inner_angle, y: outer_angle
+    int shadow; // The first shadow view of the light (-1 if it casts no shadows)
+};
+
+struct Sky {
+    vec3 top, middle, bottom;
+};
+
+// The sky and cluster data is uploaded once per frame by the renderer (see "ForwardRenderer::render")
+// The layout must match "LightingBlock" in "source/common/systems/forward-renderer.hpp"
+layout(std140) uniform Lighting {
+    Sky sky;
+    ivec3 cluster_count; // The number of tiles along x & y and the number of depth slices
+    float cluster_depth_scale;
+    vec2 cluster_tile_size; // In pixels
+    float cluster_depth_bias; // slice = log(view_depth) * cluster_depth_scale + cluster_depth_bias
+    vec4 view_depth_plane; // dot(view_depth_plane, vec4(world, 1)) is the view depth
+};
+
+// The lights are binned into clusters by the renderer (see "LightClusters" in "source/common/systems/light-clusters.hpp")
+uniform samplerBuffer light_data;      // 5 texels per light
+uniform usamplerBuffer cluster_grid;   // The (offset, count) of the light list of each cluster
+uniform usamplerBuffer cluster_lights; // The light lists of all the clusters
+
+// The shadow views are drawn into the tiles of a depth atlas by the renderer (see "ShadowMaps" in "source/common/systems/shadow-maps.hpp")
+// The layout must match "ShadowsBlock" in the same file
+#define MAX_SHADOW_VIEWS 8
+layout(std140) uniform Shadows {
+    mat4 shadow_matrices[MAX_SHADOW_VIEWS]; // From world space to the [0, 1] space of each view's tile
+    vec4 shadow_tiles[MAX_SHADOW_VIEWS];    // xy: the tile corner in the atlas, zw: the tile size
+    vec4 cascade_splits; // The view depth at which each cascade of the directional shadow ends
+    int cascade_count;
+    float shadow_bias;
+    float shadow_normal_bias; // The world space offset along the normal (against the acne on the surfaces facing away from the light)
+};
+uniform sampler2DShadow shadow_atlas;
+
+Light fetch_light(int index){
+    int texel = index * 5;
+    vec4 data0 = texelFetch(light_data, texel);
+    vec4 data1 = texelFetch(light_data, texel + 1);
+    vec4 data2 = texelFetch(light_data, texel + 2);
+    Light light;
+    light.type = int(data0.w);
+    light.position = data0.xyz;
+    light.direction = data1.xyz;
+    light.diffuse = data2.rgb;
+    vec4 data3 = texelFetch(light_data, texel + 3);
+    light.specular = data3.rgb;
+    light.shadow = int(data3.w);
+    light.attenuation = texelFetch(light_data, texel + 4).xyz;
+    light.cone_angles = vec2(data1.w, data2.w);
+    return light;
+}
+
+// Returns the index of the cluster that contains the current fragment (whose view depth is given)
+int get_cluster(float view_depth){
+    int slice = clamp(int(floor(log(view_depth) * cluster_depth_scale + cluster_depth_bias)), 0, cluster_count.z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / cluster_tile_size), ivec2(0), cluster_count.xy - 1);
+    return tile.x + cluster_count.x * (tile.y + cluster_count.y * slice);
+}
+
+// Returns how much of the light reaches the given point (1: lit, 0: in shadow)
+float get_shadow(Light light, vec3 world, vec3 normal, float view_depth){
+    if(light.shadow < 0) return 1.0;
+    int view = light.shadow;
+    // The directional lights have one view per cascade, the nearest cascade that contains the point is used
+    if(light.type == DIRECTIONAL){
+        int cascade = 0;
+        while(cascade < cascade_count && view_depth > cascade_splits[cascade]) cascade++;
+        if(cascade >= cascade_count) return 1.0;
+        view += cascade;
+    }
+    vec4 position = shadow_matrices[view] * vec4(world + normal * shadow_normal_bias, 1.0);
+    vec3 coord = position.xyz / position.w;
+    if(any(lessThan(coord, vec3(0.0))) || any(greaterThan(coord, vec3(1.0)))) return 1.0;
+    // The filter footprint is kept inside the tile so that it never reads the neighbouring views
+    vec4 tile = shadow_tiles[view];
+    vec2 texel = 1.0 / vec2(textureSize(shadow_atlas, 0));
+    vec2 uv = clamp(tile.xy + coord.xy * tile.zw, tile.xy + texel, tile.xy + tile.zw - texel);
+    return texture(shadow_atlas, vec3(uv, coord.z - shadow_bias));
+}
@@ -1,36 +1,22 @@
 #version 330
 
-#define MAX_LIGHTS 16
-
-#define DIRECTIONAL 0
-#define POINT 1
-#define SPOT 2
-
-struct Light {
-    int type;
-    vec3 position;
-    vec3 direction;
-    vec3 diffuse;
-    vec3 specular;
-    vec3 attenuation; // x*d^2 + y*d + z
-    vec2 cone_angles; // x: inner_angle, y: outer_angle
-};
-
-uniform Light lights[MAX_LIGHTS];
-uniform int light_count;
+// INSTANCED only changes the vertex shader. HAS_EMISSIVE and HAS_AO: the material has an emissive / ambient occlusion map
+// (without them, the material has no emission and no occlusion, and the maps are neither bound nor sampled)
+#pragma keywords HAS_EMISSIVE HAS_AO
 
-struct Sky {
-    vec3 top, middle, bottom;
-};
-
-uniform Sky sky;
+// The lights, their clusters and their shadows
+#include "include/lighting.glsl"
 
 struct Material {
     sampler2D albedo;
     sampler2D specular;
+#ifdef HAS_AO
     sampler2D ambient_occlusion;
+#endif
     sampler2D roughness;
+#ifdef HAS_EMISSIVE
     sampler2D emissive;
+#endif
 };
 
 uniform Material material;
@@ -54,12 +40,20 @@ void main(){
 
     vec3 material_diffuse = texture(material.albedo, fs_in.tex_coord).rgb;
     vec3 material_specular = texture(material.specular, fs_in.tex_coord).rgb;
+#ifdef HAS_AO
     vec3 material_ambient = material_diffuse * texture(material.ambient_occlusion, fs_in.tex_coord).r;
+#else
+    vec3 material_ambient = material_diffuse;
+#endif
     
     float material_roughness = texture(material.roughness, fs_in.tex_coord).r;
     float material_shininess = 2.0 / pow(clamp(material_roughness, 0.001, 0.999), 4.0) - 2.0;
 
+#ifdef HAS_EMISSIVE
     vec3 material_emissive = texture(material.emissive, fs_in.tex_coord).rgb;
+#else
+    vec3 material_emissive = vec3(0.0);
+#endif
     
     //? Compute the sky light based on the vertex normal
 
@@ -69,14 +63,13 @@ void main(){
     //? Initialize the fragment color with emissive and ambient components
 
     frag_color = vec4(material_emissive + material_ambient  , 1.0);
-    //? Clamp the number of lights to the maximum defined
+    //? Only the lights of the fragment's cluster can reach it
 
-    int clamped_light_count = min(MAX_LIGHTS, light_count);
-    
-    //? Clamp the number of lights to the maximum defined
+    float view_depth = max(dot(view_depth_plane, vec4(fs_in.world, 1.0)), 1e-4);
+    uvec2 cluster = texelFetch(cluster_grid, get_cluster(view_depth)).xy;
 
-    for(int i = 0; i < clamped_light_count; i++){
-        Light light = lights[i];
+    for(uint i = 0u; i < cluster.y; i++){
+        Light light = fetch_light(int(texelFetch(cluster_lights, int(cluster.x + i)).r));
 
         vec3 direction_to_light = -light.direction;
         if(light.type != DIRECTIONAL){
@@ -102,6 +95,6 @@ void main(){
         }
         
         //? Add the diffuse and specular components to the fragment color with attenuation
-        frag_color.rgb += (diffuse + specular) * attenuation;
+        frag_color.rgb += (diffuse + specular) * attenuation * get_shadow(light, fs_in.world, normal, view_depth);
     }
 }
\ No newline at end of file
@@ -1,9 +1,20 @@
 #version 330
 
-uniform vec3 eye;
-uniform mat4 VP;
+// INSTANCED: the model matrices are read per instance (see "InstanceData" in "source/common/mesh/mesh.hpp")
+#pragma keywords INSTANCED
+
+#include "include/camera.glsl"
+
+#ifdef INSTANCED
+layout(location = 4) in mat4 M;
+layout(location = 8) in mat4 M_IT;
+#else
 uniform mat4 M;
 uniform mat4 M_IT;
+#endif
+
+// The depth pre-pass (see "depth-only.vert") must give exactly the same depth since the color pass may test it with GL_EQUAL
+invariant gl_Position;
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec4 color;
@@ -37,4 +48,4 @@ void main() {
 
     //? Pass the world space position to the fragment shader
     vs_out.world = world;
-}
\ No newline at end of file
+}
@@ -9,7 +9,10 @@ out vec4 frag_color;
 
 // How far (in the texture space) is the distance (on the x-axis) between
 // the pixels from which the red/green (or green/blue) channels are sampled
+// It can be overriden by the renderer config (see "postprocessDefines" in "ForwardRenderer::initialize")
+#ifndef STRENGTH
 #define STRENGTH 0.005
+#endif
 
 // Chromatic aberration mimics some old cameras where the lens disperses light
 // differently based on its wavelength. In this shader, we will implement a
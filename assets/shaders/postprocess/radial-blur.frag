@@ -8,9 +8,14 @@ in vec2 tex_coord;
 out vec4 frag_color;
 
 // The number of samples we read to compute the blurring effect
+// These defaults can be overriden by the renderer config (see "postprocessDefines" in "ForwardRenderer::initialize")
+#ifndef STEPS
 #define STEPS 16
+#endif
 // The strength of the blurring effect
+#ifndef STRENGTH
 #define STRENGTH 0.2
+#endif
 
 void main(){
     // To apply radial blur, we compute the direction outward from the center to the current pixel
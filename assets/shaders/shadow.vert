@@ -0,0 +1,11 @@
+#version 330
+
+// Draws the depth of a shadow caster into a tile of the shadow atlas (see "ShadowMaps::drawCasters")
+uniform mat4 VP;
+uniform mat4 M;
+
+layout(location = 0) in vec3 position;
+
+void main() {
+    gl_Position = VP * (M * vec4(position, 1.0));
+}
@@ -0,0 +1,26 @@
+#version 330 core
+
+// ALPHA_TEST: the pixels whose alpha is below "alphaThreshold" are discarded
+#pragma keywords ALPHA_TEST
+
+in Varyings {
+    vec4 color;
+    vec2 tex_coord;
+} fs_in;
+
+out vec4 frag_color;
+
+uniform vec4 tint;
+// The texture array shared by many materials and the layer of this material
+uniform sampler2DArray tex;
+uniform float layer;
+#ifdef ALPHA_TEST
+uniform float alphaThreshold;
+#endif
+
+void main(){
+    frag_color = tint * fs_in.color * texture(tex, vec3(fs_in.tex_coord, layer));
+#ifdef ALPHA_TEST
+    if(frag_color.a < alphaThreshold) discard;
+#endif
+}
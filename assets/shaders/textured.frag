@@ -1,5 +1,8 @@
 #version 330 core
 
+// ALPHA_TEST: the pixels whose alpha is below "alphaThreshold" are discarded
+#pragma keywords ALPHA_TEST
+
 in Varyings {
     vec4 color;
     vec2 tex_coord;
@@ -9,9 +12,15 @@ out vec4 frag_color;
 
 uniform vec4 tint;
 uniform sampler2D tex;
+#ifdef ALPHA_TEST
+uniform float alphaThreshold;
+#endif
 
 void main(){
     //TODO: (Req 7) Modify the following line to compute the fragment color
     // by multiplying the tint with the vertex color and with the texture color 
     frag_color = tint * fs_in.color * texture(tex, fs_in.tex_coord);
+#ifdef ALPHA_TEST
+    if(frag_color.a < alphaThreshold) discard;
+#endif
 }
\ No newline at end of file
@@ -1,5 +1,9 @@
 #version 330 core
 
+// INSTANCED: the model matrix is read per instance (see "InstanceData" in "source/common/mesh/mesh.hpp")
+// and the view-projection matrix comes from the camera block, instead of the "transform" uniform
+#pragma keywords INSTANCED
+
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec4 color;
 
@@ -7,10 +11,19 @@ out Varyings {
     vec4 color;
 } vs_out;
 
+#ifdef INSTANCED
+#include "include/camera.glsl"
+layout(location = 4) in mat4 M;
+#else
 uniform mat4 transform;
+#endif
 
 void main(){
     //TODO: (Req 7) Change the next line to apply the transformation matrix
+#ifdef INSTANCED
+    gl_Position = VP * M * vec4(position, 1.0);
+#else
     gl_Position = transform * vec4(position, 1.0);
+#endif
     vs_out.color = color;
-}
\ No newline at end of file
+}
@@ -0,0 +1,16 @@
+param([string[]] $benchmarks)
+
+# Runs the benchmark configs (all of them by default). Each one writes its results to "benchmarks/<name>.json"
+if ($benchmarks.Count -eq 0) {
+    $benchmarks = @(
+        "play",
+        "menu-to-play"
+    )
+}
+
+foreach ($benchmark in $benchmarks){
+    Write-Output ""
+    Write-Output "Running benchmark: $benchmark"
+    Write-Output ""
+    ./bin/GAME_APPLICATION -c="config/benchmark/$benchmark.jsonc"
+}
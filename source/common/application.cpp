@@ -9,6 +9,9 @@
 #include <queue>
 #include <tuple>
 #include <filesystem>
+#include <memory>
+#include <cmath>
+#include <algorithm>
 
 #include <flags/flags.h>
 
@@ -23,6 +26,13 @@
 #endif
 
 #include "texture/screenshot.hpp"
+#include "gl-state-cache.hpp"
+#include "asset-cache.hpp"
+#include "texture/texture-utils.hpp"
+#include "texture/texture-uploader.hpp"
+#include "shader/program-binary-cache.hpp"
+#include "profiler.hpp"
+#include "benchmark.hpp"
 
 std::string default_screenshot_filepath() {
     std::stringstream stream;
@@ -163,6 +173,13 @@ int our::Application::run(int run_for_frames) {
 
     configureOpenGL(); // This function sets OpenGL window hints.
 
+    // In benchmark mode, the frames use a fixed timestep and a scripted input track (see "our::Benchmark")
+    std::unique_ptr<our::Benchmark> benchmark;
+    if(auto& benchmark_config = app_config["benchmark"]; benchmark_config.is_object()) {
+        benchmark = std::make_unique<our::Benchmark>(benchmark_config);
+        if(benchmark->isHidden()) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+
     auto win_config = getWindowConfiguration();             // Returns the WindowConfiguration current struct instance.
 
     // Create a window with the given "WindowConfiguration" attributes.
@@ -196,6 +213,15 @@ int our::Application::run(int run_for_frames) {
     glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
 #endif
 
+    if(benchmark) {
+        // Don't wait for the vertical sync, otherwise every frame would take at least one refresh period
+        glfwSwapInterval(0);
+        benchmark->initialize(getFrameBufferSize());
+        // The benchmark reports the profiler scopes and counters
+        our::Profiler::setEnabled(true);
+        if(run_for_frames == 0) run_for_frames = benchmark->getFrameCount();
+    }
+
     setupCallbacks();
     keyboard.enable(window);
     mouse.enable(window);
@@ -227,6 +253,42 @@ int our::Application::run(int run_for_frames) {
         }
     }
 
+    // The textures are compressed (if supported by the driver) when "textureCompression" is true
+    our::texture_utils::setCompressionEnabled(app_config.value("textureCompression", false));
+
+    // The linked shader programs are saved to this directory and loaded from it on the next runs (if the driver supports it)
+    // e.g. "shaderCache": { "enabled": true, "directory": "cache/shaders" }
+    if(auto& shaderCache = app_config["shaderCache"]; shaderCache.is_object()) {
+        our::ProgramBinaryCache::setEnabled(shaderCache.value("enabled", true));
+        our::ProgramBinaryCache::setDirectory(shaderCache.value("directory", std::string("cache/shaders")));
+    }
+
+    // The assets shared between the states are kept in the cache as long as they fit in this budget (in megabytes)
+    // e.g. "assetCache": { "budget": 256 }
+    if(auto& assetCache = app_config["assetCache"]; assetCache.is_object()) {
+        our::AssetCache::setBudget(size_t(assetCache.value("budget", 256)) << 20);
+    }
+
+    // The profiler records the CPU & GPU timings of the frames. Its overlay is toggled by F3 and F4 exports a Chrome trace
+    // e.g. "profiler": { "enabled": true, "overlay": false, "trace": "profiles/trace.json" }
+    // where "trace" (optional) is the file to which the trace is exported at exit
+    std::string exit_trace_path;
+    if(auto& profiler = app_config["profiler"]; profiler.is_object()) {
+        our::Profiler::setEnabled(profiler.value("enabled", false));
+        our::Profiler::setOverlayVisible(profiler.value("overlay", false));
+        exit_trace_path = profiler.value("trace", "");
+    }
+
+    // The fixed timestep of the simulation and the maximum number of steps per frame
+    // e.g. "simulation": { "timestep": 0.0166667, "maxStepsPerFrame": 5 }
+    // In benchmark mode, the timestep defaults to the benchmark timestep so that every frame runs exactly one step
+    if(benchmark) fixedTimestep = benchmark->getTimestep();
+    if(auto& simulation = app_config["simulation"]; simulation.is_object()) {
+        fixedTimestep = simulation.value("timestep", fixedTimestep);
+        maxFixedStepsPerFrame = std::max(simulation.value("maxStepsPerFrame", maxFixedStepsPerFrame), 1);
+    }
+    double fixed_time_accumulator = 0.0; // The simulated time that is still owed to the simulation
+
     // If a scene change was requested, apply it
     if(nextState) {
         currentState = nextState;
@@ -242,14 +304,45 @@ int our::Application::run(int run_for_frames) {
     //Game loop
     while(!glfwWindowShouldClose(window)){
         if(run_for_frames != 0 && current_frame >= run_for_frames) break;
-        glfwPollEvents(); // Read all the user events and call relevant callbacks.
+        our::Profiler::newFrame();
+        if(benchmark) benchmark->recordFrame(current_frame - 1);
+        OUR_PROFILE_SCOPE("Frame");
+        {
+            OUR_PROFILE_SCOPE("Events");
+            glfwPollEvents(); // Read all the user events and call relevant callbacks.
+        }
+        if(benchmark) {
+            // Replay the scripted input as if it came from the GLFW callbacks
+            for(auto& event : benchmark->takeInputEvents(current_frame)) {
+                switch(event.type) {
+                case our::BenchmarkInputEvent::Type::Key:
+                    keyboard.keyEvent(event.code, 0, event.action, 0);
+                    if(currentState) currentState->onKeyEvent(event.code, 0, event.action, 0);
+                    break;
+                case our::BenchmarkInputEvent::Type::CursorMove:
+                    mouse.CursorMoveEvent(event.position.x, event.position.y);
+                    if(currentState) currentState->onCursorMoveEvent(event.position.x, event.position.y);
+                    break;
+                case our::BenchmarkInputEvent::Type::MouseButton:
+                    mouse.MouseButtonEvent(event.code, event.action, 0);
+                    if(currentState) currentState->onMouseButtonEvent(event.code, event.action, 0);
+                    break;
+                }
+            }
+            // The systems that read the GLFW timer directly see the simulated time
+            glfwSetTime(current_frame * benchmark->getTimestep());
+        }
 
         // Start a new ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
-        if(currentState) currentState->onImmediateGui(); // Call to run any required Immediate GUI.
+        {
+            OUR_PROFILE_SCOPE("Immediate GUI");
+            if(currentState) currentState->onImmediateGui(); // Call to run any required Immediate GUI.
+            our::Profiler::drawOverlay();
+        }
 
         if (currentState == states["play"] && gameState == GameState::PLAYING)
             {
@@ -257,7 +350,6 @@ int our::Application::run(int run_for_frames) {
                 if (timeDiff != 0) //  stop at 0
                     {
                         timeDiff = int(timerValue - abs(startTime - endTime));
-                        std::cout<< timeDiff <<std::endl;
                     }
             }
         // If ImGui is using the mouse or keyboard, then we don't want the captured events to affect our keyboard and mouse objects.
@@ -276,8 +368,44 @@ int our::Application::run(int run_for_frames) {
         // Get the current time (the time at which we are starting the current frame).
         double current_frame_time = glfwGetTime();
 
+        // ImGui (and any raw OpenGL call since the last frame) changed the OpenGL state behind the state cache, so we reset it
+        our::GLStateCache::invalidate();
+        if(benchmark) benchmark->bindFramebuffer();
+
+        // Continue the background texture uploads. If a screenshot of this frame is requested, we wait for all of them
+        // so that the screenshot never shows the placeholder texture
+        {
+            OUR_PROFILE_SCOPE("Texture uploads");
+            if(!requested_screenshots.empty() && requested_screenshots.top().first == current_frame)
+                our::TextureUploader::finish();
+            else
+                our::TextureUploader::update();
+        }
+
+        double delta_time = benchmark ? benchmark->getTimestep() : current_frame_time - last_frame_time;
+
+        // Advance the simulation by as many fixed steps as fit in the time since the last frame
+        // The remainder is carried to the next frame and tells the renderer how far to interpolate between the last two steps
+        {
+            OUR_PROFILE_SCOPE("Fixed update");
+            fixed_time_accumulator += delta_time;
+            int steps = 0;
+            // Stop stepping once a state change is requested (e.g. the game is lost), the next state starts from a fresh accumulator
+            while(fixed_time_accumulator >= fixedTimestep && steps < maxFixedStepsPerFrame && !nextState) {
+                if(currentState) currentState->onFixedUpdate(fixedTimestep);
+                fixed_time_accumulator -= fixedTimestep;
+                steps++;
+            }
+            // If the frame was too slow to catch up, drop the time we couldn't simulate (the game slows down instead of freezing)
+            if(fixed_time_accumulator >= fixedTimestep) fixed_time_accumulator = std::fmod(fixed_time_accumulator, fixedTimestep);
+            interpolationFactor = fixed_time_accumulator / fixedTimestep;
+        }
+
         // Call onDraw, in which we will draw the current frame, and send to it the time difference between the last and current frame
-        if(currentState) currentState->onDraw(current_frame_time - last_frame_time);
+        {
+            OUR_PROFILE_SCOPE("Draw");
+            if(currentState) currentState->onDraw(delta_time);
+        }
         last_frame_time = current_frame_time; // Then update the last frame start time (this frame is now the last frame)
 
 #if defined(ENABLE_OPENGL_DEBUG_MESSAGES)
@@ -285,13 +413,30 @@ int our::Application::run(int run_for_frames) {
         glDisable(GL_DEBUG_OUTPUT);
         glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
 #endif
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData()); // Render the ImGui to the framebuffer
+        {
+            OUR_PROFILE_GPU_SCOPE("ImGui");
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData()); // Render the ImGui to the framebuffer
+        }
 #if defined(ENABLE_OPENGL_DEBUG_MESSAGES)
         // Re-enable the debug messages
         glEnable(GL_DEBUG_OUTPUT);
         glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
 #endif
 
+        // F3 toggles the profiler overlay (and starts profiling if it was off) and F4 exports the recorded frames as a Chrome trace
+        if(keyboard.justPressed(GLFW_KEY_F3)){
+            our::Profiler::setOverlayVisible(!our::Profiler::isOverlayVisible());
+            if(our::Profiler::isOverlayVisible()) our::Profiler::setEnabled(true);
+        }
+        if(keyboard.justPressed(GLFW_KEY_F4)){
+            std::string path = "profiles/trace-" + std::to_string(current_frame) + ".json";
+            if(our::Profiler::exportChromeTrace(path)){
+                std::cout << "Profiler trace saved to: " << path << std::endl;
+            } else {
+                std::cerr << "Failed to save the profiler trace to: " << path << std::endl;
+            }
+        }
+
         // If F12 is pressed, take a screenshot
         if(keyboard.justPressed(GLFW_KEY_F12)){
             glViewport(0, 0, frame_buffer_size.x, frame_buffer_size.y);
@@ -315,13 +460,17 @@ int our::Application::run(int run_for_frames) {
         }
 
         // Swap the frame buffers
-        glfwSwapBuffers(window);
+        {
+            OUR_PROFILE_SCOPE("Swap buffers");
+            glfwSwapBuffers(window);
+        }
 
         // Update the keyboard and mouse data
         keyboard.update();
         mouse.update();
 
         // If a scene change was requested, apply it
+        OUR_PROFILE_SCOPE("State change");
         while(nextState){
             // If a scene was already running, destroy it (not delete since we can go back to it later)
             if(currentState && nextState != states["pause"]) 
@@ -345,14 +494,31 @@ int our::Application::run(int run_for_frames) {
                 }else{
                     gameState = GameState::PLAYING;
                 }
-                
+            // The new state starts its simulation from scratch (and the time spent initializing it is not simulated)
+            fixed_time_accumulator = 0.0;
+            interpolationFactor = 1.0;
+            last_frame_time = glfwGetTime();
         }
 
         ++current_frame;
     }
 
+    if(benchmark) {
+        // Finish the last frame then report the results
+        our::Profiler::newFrame();
+        benchmark->recordFrame(current_frame - 1);
+        if(!benchmark->writeReport()) std::cerr << "Failed to save the benchmark results" << std::endl;
+    }
+
     // Call for cleaning up
     if(currentState) currentState->onDestroy();
+    if(!exit_trace_path.empty() && !our::Profiler::exportChromeTrace(exit_trace_path))
+        std::cerr << "Failed to save the profiler trace to: " << exit_trace_path << std::endl;
+    // Delete the pending uploads, the profiler queries and the cached assets while the OpenGL context still exists
+    our::TextureUploader::clear();
+    our::Profiler::destroy();
+    if(benchmark) benchmark->destroy();
+    our::AssetCache::clear();
 
     // Shutdown ImGui & destroy the context
     ImGui_ImplOpenGL3_Shutdown();
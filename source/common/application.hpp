@@ -44,6 +44,7 @@ namespace our {
     public:
         virtual void onInitialize(){}                   // Called once before the game loop.
         virtual void onImmediateGui(){}                 // Called every frame to draw the Immediate GUI (if any).
+        virtual void onFixedUpdate(double fixedDeltaTime){} // Called zero or more times per frame (before onDraw) to advance the simulation by a fixed timestep.
         virtual void onDraw(double deltaTime){}         // Called every frame in the game loop passing the time taken to draw the frame "Delta time".
         virtual void onDestroy(){}                      // Called once after the game loop ends for house cleaning.
 
@@ -85,6 +86,11 @@ namespace our {
         time_t startTime, endTime;
         int timeDiffOnPause;
 
+        // The simulation advances in steps of "fixedTimestep" seconds regardless of the frame rate (see "State::onFixedUpdate")
+        double fixedTimestep = 1.0 / 60.0;
+        int maxFixedStepsPerFrame = 5;  // Limits the steps of a slow frame so that the simulation can't fall further and further behind
+        double interpolationFactor = 1.0; // How far the current frame is between the last fixed step and the next one (0 to 1)
+
 
         
         // Virtual functions to be overrode and change the default behaviour of the application
@@ -193,6 +199,10 @@ namespace our {
             return timeDiff;
         }
 
+        double getFixedTimestep() const { return fixedTimestep; }
+        // The states use it to draw the entities between their previous and current fixed step transforms
+        double getInterpolationFactor() const { return interpolationFactor; }
+
         // Class Getters.
         GLFWwindow* getWindow(){ return window; }
         [[nodiscard]] const GLFWwindow* getWindow() const { return window; }
@@ -0,0 +1,126 @@
+#include "asset-cache.hpp"
+
+#include "shader/shader.hpp"
+#include "texture/texture2d.hpp"
+#include "texture/texture-array.hpp"
+#include "texture/texture-utils.hpp"
+#include "mesh/mesh.hpp"
+#include "mesh/mesh-utils.hpp"
+
+namespace our {
+
+    size_t estimateMemorySize(const ShaderProgram*) {
+        // The size of the compiled programs is not exposed by OpenGL 3.3 and is negligible next to the textures
+        return 0;
+    }
+
+    // Sums the sizes of all the allocated mip levels of the texture bound to the given target
+    // (the first level with a zero width is past the end of the chain)
+    static size_t getBoundTextureSize(GLenum target) {
+        size_t bytes = 0;
+        for(GLint level = 0; ; level++){
+            GLint width = 0, height = 0, depth = 1, compressed = GL_FALSE;
+            glGetTexLevelParameteriv(target, level, GL_TEXTURE_WIDTH, &width);
+            if(width == 0) break;
+            glGetTexLevelParameteriv(target, level, GL_TEXTURE_HEIGHT, &height);
+            if(target == GL_TEXTURE_2D_ARRAY) glGetTexLevelParameteriv(target, level, GL_TEXTURE_DEPTH, &depth);
+            glGetTexLevelParameteriv(target, level, GL_TEXTURE_COMPRESSED, &compressed);
+            if(compressed){
+                GLint compressedSize = 0;
+                glGetTexLevelParameteriv(target, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressedSize);
+                bytes += size_t(compressedSize);
+            } else {
+                // The uncompressed textures that we load are always RGBA with 8 bits per channel
+                bytes += size_t(width) * size_t(height) * size_t(depth) * 4;
+            }
+        }
+        return bytes;
+    }
+
+    size_t estimateMemorySize(const Texture2D* texture) {
+        // Bind the texture itself (not its placeholder). If it is still uploading, it has no storage yet and its size is updated later
+        GLStateCache::bindTexture2D(texture->getOpenGLName());
+        return getBoundTextureSize(GL_TEXTURE_2D);
+    }
+
+    size_t estimateMemorySize(const TextureArray* texture) {
+        texture->bind();
+        return getBoundTextureSize(GL_TEXTURE_2D_ARRAY);
+    }
+
+    size_t estimateMemorySize(const Mesh* mesh) {
+        return mesh->getMemorySize();
+    }
+
+    void AssetCache::deleteEntry(std::unordered_map<std::string, Entry>::iterator it) {
+        totalMemorySize -= it->second.memorySize;
+        keys.erase(it->second.asset);
+        it->second.destroy(it->second.asset);
+        entries.erase(it);
+    }
+
+    bool AssetCache::release(const void* asset) {
+        auto keyIt = keys.find(asset);
+        if(keyIt == keys.end()) return false;
+        Entry& entry = entries[keyIt->second];
+        if(entry.references > 0 && --entry.references == 0){
+            entry.lastRelease = ++releaseCounter;
+            evict();
+        }
+        return true;
+    }
+
+    void AssetCache::setMemorySize(const void* asset, size_t bytes) {
+        auto keyIt = keys.find(asset);
+        if(keyIt == keys.end()) return;
+        Entry& entry = entries[keyIt->second];
+        totalMemorySize = totalMemorySize - entry.memorySize + bytes;
+        entry.memorySize = bytes;
+    }
+
+    void AssetCache::setBudget(size_t bytes) {
+        budget = bytes;
+        evict();
+    }
+
+    void AssetCache::evict() {
+        while(totalMemorySize > budget){
+            // Find the unused asset that was released first
+            auto victim = entries.end();
+            for(auto it = entries.begin(); it != entries.end(); ++it){
+                if(it->second.references != 0) continue;
+                if(victim == entries.end() || it->second.lastRelease < victim->second.lastRelease) victim = it;
+            }
+            if(victim == entries.end()) return; // Everything left is in use
+            deleteEntry(victim);
+        }
+    }
+
+    void AssetCache::clear() {
+        while(!entries.empty()) deleteEntry(entries.begin());
+    }
+
+    ShaderProgram* acquireShader(const std::string& vertexShaderPath, const std::string& fragmentShaderPath,
+                                 const std::vector<std::string>& defines) {
+        return AssetCache::acquire<ShaderProgram>(AssetCache::shaderKey(vertexShaderPath, fragmentShaderPath, defines), [&]{
+            auto shader = new ShaderProgram();
+            shader->attach(vertexShaderPath, GL_VERTEX_SHADER, defines);
+            shader->attach(fragmentShaderPath, GL_FRAGMENT_SHADER, defines);
+            shader->link();
+            return shader;
+        });
+    }
+
+    Texture2D* acquireTexture(const std::string& path, bool generateMipmap) {
+        return AssetCache::acquire<Texture2D>(AssetCache::textureKey(path, generateMipmap), [&]{
+            return texture_utils::loadImageAsync(path, generateMipmap);
+        });
+    }
+
+    Mesh* acquireOBJ(const std::string& path) {
+        return AssetCache::acquire<Mesh>(AssetCache::meshKey(path), [&]{
+            return mesh_utils::loadOBJ(path);
+        });
+    }
+
+}
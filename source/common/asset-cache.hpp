@@ -0,0 +1,108 @@
+#pragma once
+
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace our {
+
+    class ShaderProgram;
+    class Texture2D;
+    class TextureArray;
+    class Mesh;
+
+    // Returns an estimate of the VRAM used by an asset (used to apply the cache budget)
+    size_t estimateMemorySize(const ShaderProgram* shader);
+    size_t estimateMemorySize(const Texture2D* texture);
+    size_t estimateMemorySize(const TextureArray* texture);
+    size_t estimateMemorySize(const Mesh* mesh);
+
+    // This static class keeps the expensive assets (shaders, textures and meshes) alive across state changes.
+    // Each asset is identified by a key built from what it is made of (e.g. the paths of its files) and counts its owners.
+    // When the last owner releases an asset, it stays in the cache so that the next state that needs it costs no disk reads or uploads.
+    // Unused assets are only deleted when the cache grows over its memory budget (the least recently released first) or when it is cleared.
+    class AssetCache {
+        struct Entry {
+            void* asset;
+            void (*destroy)(void*);
+            size_t references;
+            size_t memorySize;
+            std::uint64_t lastRelease; // The value of "releaseCounter" when the asset was last released (used to find the least recently used)
+        };
+        static inline std::unordered_map<std::string, Entry> entries;
+        // Maps each cached asset to its key so that it can be released using its pointer only
+        static inline std::unordered_map<const void*, std::string> keys;
+        static inline size_t totalMemorySize = 0;
+        static inline size_t budget = size_t(256) << 20; // 256 MB by default
+        static inline std::uint64_t releaseCounter = 0;
+
+        static void deleteEntry(std::unordered_map<std::string, Entry>::iterator it);
+
+    public:
+        // Returns the asset with the given key if it is cached. Otherwise, it calls "load" (which returns a T*) and caches its result
+        // Either way, the caller becomes one of the owners of the asset and must call "release" when it no longer needs it
+        // WARNING: never delete an asset returned by this function
+        template<typename T, typename Load>
+        static T* acquire(const std::string& key, Load&& load) {
+            if(auto it = entries.find(key); it != entries.end()){
+                it->second.references++;
+                return static_cast<T*>(it->second.asset);
+            }
+            T* asset = load();
+            if(asset == nullptr) return nullptr; // Failures are not cached so that they are retried next time
+            size_t memorySize = estimateMemorySize(asset);
+            entries[key] = Entry{asset, [](void* pointer){ delete static_cast<T*>(pointer); }, 1, memorySize, 0};
+            keys[asset] = key;
+            totalMemorySize += memorySize;
+            return asset;
+        }
+
+        // Returns true if an asset with the given key is cached
+        static bool contains(const std::string& key) { return entries.count(key) != 0; }
+
+        // Gives up one ownership of the asset. Returns false if the asset is not managed by the cache
+        // (in which case, the caller still owns it and should delete it)
+        static bool release(const void* asset);
+
+        // Replaces the memory size of a cached asset (e.g. once a texture that was uploading in the background is resident)
+        // Nothing happens if the asset is not managed by the cache
+        static void setMemorySize(const void* asset, size_t bytes);
+
+        // Sets the maximum number of bytes kept by the cache then evicts the unused assets that do not fit
+        // Note that the assets in use are never evicted, so the cache can stay over its budget while they are owned
+        static void setBudget(size_t bytes);
+        static size_t getBudget() { return budget; }
+        // Deletes the least recently released assets until the cache fits in its budget
+        static void evict();
+        // Deletes all the cached assets (even the ones in use). This should only be called at exit while the OpenGL context still exists
+        static void clear();
+
+        static size_t getMemorySize() { return totalMemorySize; }
+        static size_t getAssetCount() { return entries.size(); }
+
+        // These functions build the keys of the different asset types
+        static std::string shaderKey(const std::string& vertexShaderPath, const std::string& fragmentShaderPath,
+                                     const std::vector<std::string>& defines = {}) {
+            std::string key = "shader:" + vertexShaderPath + "|" + fragmentShaderPath;
+            for(const std::string& define : defines) key += "|" + define;
+            return key;
+        }
+        static std::string textureKey(const std::string& path, bool generateMipmap = true) {
+            return (generateMipmap ? "texture:" : "texture-no-mipmap:") + path;
+        }
+        static std::string meshKey(const std::string& path) {
+            return "mesh:" + path;
+        }
+    };
+
+    // These functions get an asset from the cache or load it if it is not cached (the textures are loaded asynchronously, see "loadImageAsync")
+    // The returned asset must be given back using "AssetCache::release"
+    // The shader stages are compiled with the given defines (see "shader_utils::preprocess"), each set of defines is a different asset
+    ShaderProgram* acquireShader(const std::string& vertexShaderPath, const std::string& fragmentShaderPath,
+                                 const std::vector<std::string>& defines = {});
+    Texture2D* acquireTexture(const std::string& path, bool generateMipmap = true);
+    Mesh* acquireOBJ(const std::string& path);
+
+}
@@ -1,30 +1,140 @@
 #include "asset-loader.hpp"
 
 #include "shader/shader.hpp"
+#include "shader/shader-variants.hpp"
+#include "shader/shader-utils.hpp"
 #include "texture/texture2d.hpp"
 #include "texture/texture-utils.hpp"
+#include "texture/texture-array.hpp"
 #include "texture/sampler.hpp"
 #include "mesh/mesh.hpp"
 #include "mesh/mesh-utils.hpp"
 #include "material/material.hpp"
 #include "deserialize-utils.hpp"
+#include "thread-pool.hpp"
+#include "profiler.hpp"
+
+#include <future>
+#include <utility>
+#include <vector>
+#include <filesystem>
 
 namespace our {
 
+    // A pending decoding job of an asset. If the asset is already in the "AssetCache", there is no job
+    template<typename Data>
+    struct DecodeJob {
+        std::string name, path;
+        std::shared_future<Data> data;
+    };
+    template<typename Data>
+    using DecodeJobs = std::vector<DecodeJob<Data>>;
+
+    // Starts decoding the files defined in "data" (in the form { asset_name : "path/to/file", ... }) on the shared thread pool
+    // The files whose assets are already cached are skipped and if multiple assets use the same file, it is only decoded once
+    template<typename Data>
+    static DecodeJobs<Data> startDecoding(const nlohmann::json& data, Data (*decode)(const std::string&), std::string (*key)(const std::string&)) {
+        DecodeJobs<Data> jobs;
+        if(!data.is_object()) return jobs;
+        std::unordered_map<std::string, std::shared_future<Data>> jobsByPath;
+        for(auto& [name, desc] : data.items()){
+            std::string path = desc.template get<std::string>();
+            auto& job = jobsByPath[path];
+            if(!job.valid() && !AssetCache::contains(key(path)))
+                job = ThreadPool::getShared().submit([decode, path]{ return decode(path); }).share();
+            jobs.push_back({name, path, job});
+        }
+        return jobs;
+    }
+
+    static std::string textureKey(const std::string& path) { return AssetCache::textureKey(path); }
+
+    // Creates the textures without waiting for their images. They are uploaded by the "TextureUploader" once decoded
+    // and show a placeholder until then, so loading a scene doesn't stall on large images (must be called on the main thread)
+    static void finishTextures(const DecodeJobs<texture_utils::ImageData>& jobs) {
+        for(auto& job : jobs){
+            AssetLoader<Texture2D>::add(job.name, AssetCache::acquire<Texture2D>(textureKey(job.path), [&]{
+                return job.data.valid() ? TextureUploader::enqueue(job.data) : texture_utils::loadImageAsync(job.path);
+            }));
+        }
+    }
+
+    // Waits for each mesh in order and creates its buffers (must be called on the main thread)
+    static void finishMeshes(const DecodeJobs<mesh_utils::MeshData>& jobs) {
+        for(auto& job : jobs){
+            AssetLoader<Mesh>::add(job.name, AssetCache::acquire<Mesh>(AssetCache::meshKey(job.path), [&]{
+                return job.data.valid() ? mesh_utils::createMesh(job.data.get()) : mesh_utils::loadOBJ(job.path);
+            }));
+        }
+    }
+
+    // A pending packing job of a texture array. If the array is already in the "AssetCache", there is no job
+    struct TextureArrayJob {
+        std::string name, key;
+        std::vector<std::string> layerNames, paths;
+        std::string cachePath;
+        glm::ivec2 size;
+        std::shared_future<texture_utils::ImageData> data;
+    };
+
+    // Starts packing the texture arrays defined in "data" on the shared thread pool (see "AssetLoader<TextureArray>::deserialize")
+    static std::vector<TextureArrayJob> startTextureArrays(const nlohmann::json& data) {
+        std::vector<TextureArrayJob> jobs;
+        if(!data.is_object()) return jobs;
+        for(auto& [name, desc] : data.items()){
+            TextureArrayJob job;
+            job.name = name;
+            // The key contains the whole description since the layers and the size define the content of the array
+            job.key = "texture-array:" + desc.dump();
+            job.size = desc.value("size", glm::ivec2(256, 256));
+            if(desc.contains("layers") && desc["layers"].is_object()){
+                for(auto& [layerName, path] : desc["layers"].items()){
+                    job.layerNames.push_back(layerName);
+                    job.paths.push_back(path.get<std::string>());
+                }
+            }
+            if(job.paths.empty()) continue;
+            // By default, the packed array is cached next to its first image
+            auto defaultCachePath = std::filesystem::path(job.paths.front()).parent_path() / (name + ".array.texcache");
+            job.cachePath = desc.value("cache", defaultCachePath.string());
+            if(!AssetCache::contains(job.key)){
+                job.data = ThreadPool::getShared().submit([cachePath = job.cachePath, paths = job.paths, size = job.size]{
+                    return texture_utils::decodeImageArray(cachePath, paths, size);
+                }).share();
+            }
+            jobs.push_back(std::move(job));
+        }
+        return jobs;
+    }
+
+    // Waits for each texture array in order and uploads it (must be called on the main thread)
+    static void finishTextureArrays(const std::vector<TextureArrayJob>& jobs) {
+        for(auto& job : jobs){
+            AssetLoader<TextureArray>::add(job.name, AssetCache::acquire<TextureArray>(job.key, [&]{
+                TextureArray* array = job.data.valid() ?
+                    texture_utils::uploadImageArray(job.data.get()) :
+                    texture_utils::uploadImageArray(texture_utils::decodeImageArray(job.cachePath, job.paths, job.size));
+                if(array)
+                    for(size_t layer = 0; layer < job.layerNames.size(); layer++)
+                        array->setLayerName(job.layerNames[layer], (int)layer);
+                return array;
+            }));
+        }
+    }
+
     // This will load all the shaders defined in "data"
     // data must be in the form:
-    //    { shader_name : { "vs" : "path/to/vertex-shader", "fs" : "path/to/fragment-shader" }, ... }
+    //    { shader_name : { "vs" : "path/to/vertex-shader", "fs" : "path/to/fragment-shader", "defines" : { "NAME" : value, ... } }, ... }
+    // where "defines" (optional) are added to every variant of the shader
+    // Each shader is a family of variants (see "ShaderVariants") and the materials pick the variants they need
     template<>
-    void AssetLoader<ShaderProgram>::deserialize(const nlohmann::json& data) {
+    void AssetLoader<ShaderVariants>::deserialize(const nlohmann::json& data) {
         if(data.is_object()){
             for(auto& [name, desc] : data.items()){
                 std::string vsPath = desc.value("vs", "");
                 std::string fsPath = desc.value("fs", "");
-                auto shader = new ShaderProgram();
-                shader->attach(vsPath, GL_VERTEX_SHADER);
-                shader->attach(fsPath, GL_FRAGMENT_SHADER);
-                shader->link();
-                assets[name] = shader;
+                // Nothing is compiled yet. The variants with the same files and defines are compiled once and shared through the cache
+                add(name, new ShaderVariants(vsPath, fsPath, shader_utils::parseDefines(desc.value("defines", nlohmann::json::object()))));
             }
         }
     };
@@ -34,12 +144,17 @@ namespace our {
     //    { texture_name : "path/to/image", ... }
     template<>
     void AssetLoader<Texture2D>::deserialize(const nlohmann::json& data) {
-        if(data.is_object()){
-            for(auto& [name, desc] : data.items()){
-                std::string path = desc.get<std::string>();
-                assets[name] = texture_utils::loadImage(path);
-            }
-        }
+        finishTextures(startDecoding(data, texture_utils::decodeImage, textureKey));
+    };
+
+    // This will load all the texture arrays defined in "data"
+    // Each array packs many images (resized to the same size) as its layers, so the materials using them can share one bound texture
+    // data must be in the form:
+    //    { array_name : { "size" : [width, height], "layers" : { layer_name : "path/to/image", ... }, "cache" : "path/to/cache" }, ... }
+    // where "cache" (optional) is the file in which the packed mip chains are saved (by default, it is next to the first image)
+    template<>
+    void AssetLoader<TextureArray>::deserialize(const nlohmann::json& data) {
+        finishTextureArrays(startTextureArrays(data));
     };
 
     // This will load all the samplers defined in "data"
@@ -55,7 +170,7 @@ namespace our {
             for(auto& [name, desc] : data.items()){
                 auto sampler = new Sampler();
                 sampler->deserialize(desc);
-                assets[name] = sampler;
+                add(name, sampler);
             }
         }
     };
@@ -65,12 +180,7 @@ namespace our {
     //    { mesh_name : "path/to/3d-model-file", ... }
     template<>
     void AssetLoader<Mesh>::deserialize(const nlohmann::json& data) {
-        if(data.is_object()){
-            for(auto& [name, desc] : data.items()){
-                std::string path = desc.get<std::string>();
-                assets[name] = mesh_utils::loadOBJ(path);
-            }
-        }
+        finishMeshes(startDecoding(data, mesh_utils::parseOBJ, AssetCache::meshKey));
     };
 
     // This will load all the materials defined in "data"
@@ -92,28 +202,44 @@ namespace our {
                 std::string type = desc.value("type", "");
                 auto material = createMaterialFromType(type);
                 material->deserialize(desc);
-                assets[name] = material;
+                // The shader variants depend on the whole material data (e.g. which textures it has)
+                material->selectShaders();
+                add(name, material);
             }
         }
     };
 
     void deserializeAllAssets(const nlohmann::json& assetData){
         if(!assetData.is_object()) return;
-        if(assetData.contains("shaders"))
-            AssetLoader<ShaderProgram>::deserialize(assetData["shaders"]);
+        OUR_PROFILE_SCOPE("Load assets");
+        // First, we queue the CPU work (reading & decoding the images and models) on the worker threads
+        DecodeJobs<texture_utils::ImageData> textureJobs;
+        DecodeJobs<mesh_utils::MeshData> meshJobs;
+        std::vector<TextureArrayJob> textureArrayJobs;
         if(assetData.contains("textures"))
-            AssetLoader<Texture2D>::deserialize(assetData["textures"]);
+            textureJobs = startDecoding(assetData["textures"], texture_utils::decodeImage, textureKey);
+        if(assetData.contains("textureArrays"))
+            textureArrayJobs = startTextureArrays(assetData["textureArrays"]);
+        if(assetData.contains("meshes"))
+            meshJobs = startDecoding(assetData["meshes"], mesh_utils::parseOBJ, AssetCache::meshKey);
+        // Meanwhile, the main thread does the work that needs the OpenGL context
+        if(assetData.contains("shaders"))
+            AssetLoader<ShaderVariants>::deserialize(assetData["shaders"]);
         if(assetData.contains("samplers"))
             AssetLoader<Sampler>::deserialize(assetData["samplers"]);
-        if(assetData.contains("meshes"))
-            AssetLoader<Mesh>::deserialize(assetData["meshes"]);
+        // Then we upload the decoded data as soon as each job is done (the textures are uploaded in the background)
+        finishTextures(textureJobs);
+        finishTextureArrays(textureArrayJobs);
+        finishMeshes(meshJobs);
+        // Materials come last since they depend on shaders, textures (and texture arrays) and samplers
         if(assetData.contains("materials"))
             AssetLoader<Material>::deserialize(assetData["materials"]);
     }
 
     void clearAllAssets(){
-        AssetLoader<ShaderProgram>::clear();
+        AssetLoader<ShaderVariants>::clear();
         AssetLoader<Texture2D>::clear();
+        AssetLoader<TextureArray>::clear();
         AssetLoader<Sampler>::clear();
         AssetLoader<Mesh>::clear();
         AssetLoader<Material>::clear();
@@ -4,6 +4,8 @@
 #include <string>
 #include <json/json.hpp>
 
+#include "asset-cache.hpp"
+
 namespace our {
 
     // This static template class will hold the loaded assets
@@ -14,7 +16,13 @@ namespace our {
     class AssetLoader {
         // This map stores a pointer to each asset identified by its name
         // All assets in this map are owned by the asset loader so it should not be deleted outside of this class
+        // Shaders, textures and meshes are shared with the "AssetCache" so they are released (instead of deleted) when cleared
         static inline std::unordered_map<std::string, T*> assets;
+
+        // Gives up an asset: the cached assets are released and the others are deleted
+        static void drop(T* asset) {
+            if(!AssetCache::release(asset)) delete asset;
+        }
     public:
         // This function loads the assets defined by the given json object
         // The json object should be defined in the form: {asset_name: asset_description}
@@ -32,10 +40,19 @@ namespace our {
             }
             return nullptr;
         };
+        // This function adds an asset under the given name. The asset will be owned by the asset loader
+        // (if it came from the "AssetCache", the asset loader owns one of its references)
+        // If another asset had the same name, it is dropped
+        static void add(const std::string& name, T* asset) {
+            T*& slot = assets[name];
+            if(slot != nullptr) drop(slot);
+            slot = asset;
+        }
         // This function deletes all the assets held by this class and clear the assets map 
+        // The cached assets are only released, so the next state that loads them gets them from the cache
         static void clear(){
             for(auto& [name, asset] : assets){
-                delete asset;
+                drop(asset);
             }
             assets.clear();
         }
@@ -44,7 +61,9 @@ namespace our {
     // Given a json holding the data for all the assets
     // This function will call "AssetLoader<T>::deserialize" for all the different asset types T
     // For example, a json in the form {"shaders": ... , "textures": ... } will call "deserialize" for:
-    // AssetLoader<ShaderProgram> and AssetLoader<Texture2D>
+    // AssetLoader<ShaderVariants> and AssetLoader<Texture2D>
+    // The image and model files are read and decoded on the shared thread pool while the main thread compiles the shaders,
+    // then the textures and meshes are uploaded on the main thread (which owns the OpenGL context) before the materials are read
     void deserializeAllAssets(const nlohmann::json& assetData);
     // This will call "AssetLoader<T>::clear" for all the different asset types T
     void clearAllAssets();
@@ -0,0 +1,198 @@
+#include "benchmark.hpp"
+#include "profiler.hpp"
+#include "gl-state-cache.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace our {
+
+    // Parses a key given either as a GLFW key code or as a name (e.g. "W", "SPACE", "UP" or "LEFT_SHIFT")
+    // Returns GLFW_KEY_UNKNOWN if the key is not recognized
+    static int parseKey(const nlohmann::json& key) {
+        if(key.is_number_integer()) return key.get<int>();
+        if(!key.is_string()) return GLFW_KEY_UNKNOWN;
+        std::string name = key.get<std::string>();
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c){ return (char)std::toupper(c); });
+        // The GLFW codes of the printable keys are their ASCII codes
+        if(name.size() == 1 && (std::isalnum((unsigned char)name[0]) || name[0] == ' ')) return name[0];
+        static const std::unordered_map<std::string, int> names = {
+            {"SPACE", GLFW_KEY_SPACE}, {"ENTER", GLFW_KEY_ENTER}, {"ESCAPE", GLFW_KEY_ESCAPE}, {"TAB", GLFW_KEY_TAB},
+            {"BACKSPACE", GLFW_KEY_BACKSPACE}, {"UP", GLFW_KEY_UP}, {"DOWN", GLFW_KEY_DOWN}, {"LEFT", GLFW_KEY_LEFT},
+            {"RIGHT", GLFW_KEY_RIGHT}, {"LEFT_SHIFT", GLFW_KEY_LEFT_SHIFT}, {"RIGHT_SHIFT", GLFW_KEY_RIGHT_SHIFT},
+            {"LEFT_CONTROL", GLFW_KEY_LEFT_CONTROL}, {"RIGHT_CONTROL", GLFW_KEY_RIGHT_CONTROL},
+            {"LEFT_ALT", GLFW_KEY_LEFT_ALT}, {"RIGHT_ALT", GLFW_KEY_RIGHT_ALT}
+        };
+        if(auto it = names.find(name); it != names.end()) return it->second;
+        return GLFW_KEY_UNKNOWN;
+    }
+
+    static int parseMouseButton(const nlohmann::json& button) {
+        if(button.is_number_integer()) return button.get<int>();
+        std::string name = button.is_string() ? button.get<std::string>() : "";
+        if(name == "LEFT") return GLFW_MOUSE_BUTTON_LEFT;
+        if(name == "RIGHT") return GLFW_MOUSE_BUTTON_RIGHT;
+        if(name == "MIDDLE") return GLFW_MOUSE_BUTTON_MIDDLE;
+        return -1;
+    }
+
+    Benchmark::Benchmark(const nlohmann::json& config) {
+        warmupFrames = std::max(config.value("warmup", warmupFrames), 0);
+        measuredFrames = std::max(config.value("frames", measuredFrames), 1);
+        timestep = config.value("timestep", timestep);
+        hidden = config.value("hidden", hidden);
+        outputPath = config.value("output", outputPath);
+
+        if(auto input = config.find("input"); input != config.end() && input->is_array()){
+            for(auto& item : *input){
+                BenchmarkInputEvent event;
+                event.frame = item.value("frame", 0);
+                event.action = item.value("action", "press") == "release" ? GLFW_RELEASE : GLFW_PRESS;
+                if(item.contains("key")){
+                    event.type = BenchmarkInputEvent::Type::Key;
+                    event.code = parseKey(item["key"]);
+                    if(event.code == GLFW_KEY_UNKNOWN){
+                        std::cerr << "Benchmark: unknown key " << item["key"] << " at frame " << event.frame << std::endl;
+                        continue;
+                    }
+                } else if(item.contains("button")){
+                    event.type = BenchmarkInputEvent::Type::MouseButton;
+                    event.code = parseMouseButton(item["button"]);
+                    if(event.code < 0){
+                        std::cerr << "Benchmark: unknown mouse button " << item["button"] << " at frame " << event.frame << std::endl;
+                        continue;
+                    }
+                } else if(item.contains("cursor") && item["cursor"].is_array() && item["cursor"].size() == 2){
+                    event.type = BenchmarkInputEvent::Type::CursorMove;
+                    event.position = glm::vec2(item["cursor"][0].get<float>(), item["cursor"][1].get<float>());
+                } else continue;
+                inputEvents.push_back(event);
+            }
+        }
+        // Events of the same frame keep their order in the config
+        std::stable_sort(inputEvents.begin(), inputEvents.end(), [](const BenchmarkInputEvent& first, const BenchmarkInputEvent& second){
+            return first.frame < second.frame;
+        });
+        frameTimes.reserve(measuredFrames);
+    }
+
+    void Benchmark::initialize(glm::ivec2 size) {
+        if(!hidden) return;
+        // The default framebuffer of a hidden window may not own its pixels, so we draw into our own framebuffer instead
+        glGenRenderbuffers(1, &colorRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size.x, size.y);
+        glGenRenderbuffers(1, &depthRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size.x, size.y);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRenderbuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Benchmark: the offscreen framebuffer is incomplete" << std::endl;
+        GLStateCache::setDefaultFramebuffer(framebuffer);
+    }
+
+    void Benchmark::bindFramebuffer() const {
+        // Both the draw and read bindings are set, so the screenshots read the offscreen framebuffer too
+        if(framebuffer) glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    }
+
+    std::vector<BenchmarkInputEvent> Benchmark::takeInputEvents(int frame) {
+        std::vector<BenchmarkInputEvent> events;
+        while(nextInputEvent < inputEvents.size() && inputEvents[nextInputEvent].frame <= frame)
+            events.push_back(inputEvents[nextInputEvent++]);
+        return events;
+    }
+
+    void Benchmark::recordFrame(int frame) {
+        std::uint64_t time = Profiler::now();
+        // The first frame has no previous frame end to measure from (and it is always part of the warmup anyway)
+        bool first = lastFrameEnd == 0;
+        std::uint64_t duration = time - lastFrameEnd;
+        lastFrameEnd = time;
+        if(first || frame < warmupFrames) return;
+
+        frameTimes.push_back(double(duration) * 1e-6);
+        // A scope can run more than once per frame (e.g. one per system call), so its durations are summed per frame
+        std::map<std::string, double> frameScopes;
+        for(auto& scope : Profiler::getLastFrameScopes()) frameScopes[scope.name] += double(scope.end - scope.start) * 1e-6;
+        for(auto& [name, milliseconds] : frameScopes) cpuScopes[name].add(milliseconds);
+        frameScopes.clear();
+        for(auto& scope : Profiler::getLastGpuScopes()) frameScopes[scope.name] += double(scope.end - scope.start) * 1e-6;
+        for(auto& [name, milliseconds] : frameScopes) gpuScopes[name].add(milliseconds);
+        for(size_t index = 0; index < size_t(ProfileCounter::COUNT); index++)
+            counters[Profiler::getCounterName(ProfileCounter(index))].add((double)Profiler::getCounter(ProfileCounter(index)));
+    }
+
+    bool Benchmark::writeReport() const {
+        nlohmann::json report;
+        report["frames"] = frameTimes.size();
+        report["warmup"] = warmupFrames;
+        report["timestep"] = timestep;
+        report["renderer"] = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+
+        if(!frameTimes.empty()){
+            std::vector<double> sorted = frameTimes;
+            std::sort(sorted.begin(), sorted.end());
+            // Nearest-rank percentiles
+            auto percentile = [&](double fraction){
+                size_t rank = (size_t)std::ceil(fraction * sorted.size());
+                return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+            };
+            double total = 0;
+            for(double frameTime : sorted) total += frameTime;
+            report["frameTime"] = {
+                {"min", sorted.front()}, {"average", total / sorted.size()},
+                {"p95", percentile(0.95)}, {"p99", percentile(0.99)}, {"max", sorted.back()}
+            };
+        }
+        // The averages are over all the measured frames (a scope that didn't run in a frame counts as 0 for that frame)
+        double frameCount = (double)std::max<size_t>(frameTimes.size(), 1);
+        auto summarize = [&](const std::map<std::string, Statistic>& statistics){
+            nlohmann::json summary = nlohmann::json::object();
+            for(auto& [name, statistic] : statistics)
+                summary[name] = {{"average", statistic.total / frameCount}, {"max", statistic.maximum}};
+            return summary;
+        };
+        report["cpu"] = summarize(cpuScopes);
+        report["gpu"] = summarize(gpuScopes);
+        report["counters"] = summarize(counters);
+
+        std::string text = report.dump(4);
+        std::cout << "Benchmark results:" << std::endl << text << std::endl;
+        if(outputPath.empty()) return true;
+
+        std::filesystem::path path(outputPath);
+        if(path.has_parent_path()){
+            std::error_code ec;
+            std::filesystem::create_directories(path.parent_path(), ec);
+            if(ec) return false;
+        }
+        std::ofstream file(outputPath);
+        if(!file) return false;
+        file << text << std::endl;
+        return (bool)file;
+    }
+
+    void Benchmark::destroy() {
+        if(framebuffer == 0) return;
+        GLStateCache::setDefaultFramebuffer(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &colorRenderbuffer);
+        glDeleteRenderbuffers(1, &depthRenderbuffer);
+        framebuffer = colorRenderbuffer = depthRenderbuffer = 0;
+    }
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/vec2.hpp>
+#include <json/json.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace our {
+
+    // An input event replayed by the benchmark at a specific frame
+    struct BenchmarkInputEvent {
+        enum class Type { Key, CursorMove, MouseButton };
+        int frame;
+        Type type;
+        int code = 0;       // The GLFW key or mouse button
+        int action = 0;     // GLFW_PRESS or GLFW_RELEASE
+        glm::vec2 position = {0, 0}; // The cursor position (for CursorMove)
+    };
+
+    // A benchmark runs the application in a reproducible way to catch performance regressions:
+    // - Every frame advances the simulation by a fixed timestep (instead of the wall-clock time) and the GLFW timer is set to the simulated time.
+    // - The input comes from a scripted track instead of the user.
+    // - The window can be hidden, in which case the frames are drawn to an offscreen framebuffer (so it also runs on CI machines without a display).
+    // The frame times (after a warmup), the CPU & GPU time of each profiler scope and the profiler counters are reported as JSON.
+    // It is enabled by the "benchmark" object of the application config:
+    //    "benchmark": {
+    //        "frames": 600, "warmup": 60, "timestep": 0.0166667, "hidden": true, "output": "benchmarks/play.json",
+    //        "input": [ { "frame": 0, "key": "W", "action": "press" }, { "frame": 10, "cursor": [640, 360] },
+    //                   { "frame": 20, "button": "LEFT", "action": "press" }, ... ]
+    //    }
+    class Benchmark {
+        int warmupFrames = 60, measuredFrames = 600;
+        double timestep = 1.0 / 60.0;
+        bool hidden = true;
+        std::string outputPath;
+        std::vector<BenchmarkInputEvent> inputEvents; // Sorted by frame
+        size_t nextInputEvent = 0;
+
+        GLuint framebuffer = 0, colorRenderbuffer = 0, depthRenderbuffer = 0;
+
+        // The statistics of the measured frames
+        struct Statistic {
+            double total = 0, maximum = 0;
+            void add(double value) { total += value; if(value > maximum) maximum = value; }
+        };
+        std::uint64_t lastFrameEnd = 0;
+        std::vector<double> frameTimes; // In milliseconds
+        std::map<std::string, Statistic> cpuScopes, gpuScopes, counters;
+
+    public:
+        explicit Benchmark(const nlohmann::json& config);
+
+        bool isHidden() const { return hidden; }
+        double getTimestep() const { return timestep; }
+        // The number of frames to run (including the warmup)
+        int getFrameCount() const { return warmupFrames + measuredFrames; }
+
+        // Creates the offscreen framebuffer (if the window is hidden). It must be called once the OpenGL context exists
+        void initialize(glm::ivec2 size);
+        // Binds the offscreen framebuffer (if any) so that everything drawn to the window goes into it
+        void bindFramebuffer() const;
+
+        // Returns the scripted input events of the given frame
+        std::vector<BenchmarkInputEvent> takeInputEvents(int frame);
+
+        // Records the statistics of a finished frame. It must be called right after "Profiler::newFrame"
+        void recordFrame(int frame);
+
+        // Writes the report to the output file (if any) and prints it. Returns false if the file could not be written
+        bool writeReport() const;
+
+        // Deletes the offscreen framebuffer
+        void destroy();
+    };
+
+}
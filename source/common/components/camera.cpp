@@ -22,7 +22,8 @@ namespace our {
     // Creates and returns the camera view matrix
     glm::mat4 CameraComponent::getViewMatrix() const {
         auto owner = getOwner();
-        auto M = owner->getLocalToWorldMatrix();
+        // The view follows the drawn (interpolated) camera transform
+        auto M = owner->getRenderMatrix();
         //TODO: (Req 8) Complete this function
         //HINT:
         // In the camera space:
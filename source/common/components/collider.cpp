@@ -0,0 +1,31 @@
+#include "collider.hpp"
+#include "../ecs/entity.hpp"
+#include "../deserialize-utils.hpp"
+
+#include <unordered_map>
+#include <iostream>
+
+namespace our {
+    // Gives each layer name its own bit
+    std::uint32_t ColliderComponent::getLayerMask(const std::string& name){
+        static std::unordered_map<std::string, std::uint32_t> layers;
+        auto it = layers.find(name);
+        if(it != layers.end()) return it->second;
+        std::uint32_t mask = 0;
+        if(layers.size() < 32){
+            mask = std::uint32_t(1) << layers.size();
+        } else {
+            std::cerr << "Too many collider layers, the layer \"" << name << "\" will not collide with anything" << std::endl;
+        }
+        layers[name] = mask;
+        return mask;
+    }
+
+    // Reads center, extent & layer from the given json object
+    void ColliderComponent::deserialize(const nlohmann::json& data){
+        if(!data.is_object()) return;
+        center = data.value("center", center);
+        extent = data.value("extent", extent);
+        setLayer(data.value("layer", layer));
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../ecs/component.hpp"
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+
+namespace our {
+
+    // This component gives the owning entity an axis aligned collision box that is registered in the CollisionSystem.
+    // The box is placed at the entity's world position (plus "center") and it is NOT rotated or scaled with the entity,
+    // so the collision shape is independent from how the mesh is drawn.
+    // For more information, see "common/systems/collision.hpp"
+    class ColliderComponent : public Component {
+    public:
+        glm::vec3 center = {0, 0, 0}; // The offset of the box center from the entity's world position
+        glm::vec3 extent = {0.5f, 0.5f, 0.5f}; // Half the size of the box along each axis
+        std::string layer = "default"; // The name of the layer to which this collider belongs (e.g. "log", "car")
+        std::uint32_t layerMask = getLayerMask("default"); // The bit of the layer (see "getLayerMask")
+
+        // The ID of this component type is "Collider"
+        static std::string getID() { return "Collider"; }
+
+        // Returns the bit mask of the layer with the given name, a new bit is given to each new layer name
+        // At most 32 layers can exist, any extra layer gets a mask of 0 (so it never collides with anything)
+        static std::uint32_t getLayerMask(const std::string& name);
+
+        // Changes the layer of this collider (don't assign "layer" directly since the mask has to be updated too)
+        void setLayer(const std::string& name) {
+            layer = name;
+            layerMask = getLayerMask(name);
+        }
+
+        // Reads center, extent & layer from the given json object
+        void deserialize(const nlohmann::json& data) override;
+    };
+
+}
@@ -6,6 +6,7 @@
 #include "free-camera-controller.hpp"
 #include "movement.hpp"
 #include "light.hpp"
+#include "collider.hpp"
 
 namespace our {
 
@@ -25,6 +26,8 @@ namespace our {
             component = entity->addComponent<LightComponent>();
         }else if(type == MeshRendererComponent::getID()){
             component = entity -> addComponent<MeshRendererComponent>();
+        }else if(type == ColliderComponent::getID()){
+            component = entity->addComponent<ColliderComponent>();
         }
         if(component) component->deserialize(data);
     }
@@ -4,6 +4,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include "../deserialize-utils.hpp"
 
+#include <limits>
+
 namespace our
 {
     // Reads light parameters from the given json object
@@ -31,6 +33,23 @@ namespace our
         cone_angles = data.value("cone_angles", cone_angles);
         diffuse = data.value("diffuse", diffuse);
         specular = data.value("specular", specular);
+        castShadows = data.value("castShadows", castShadows);
+    }
+
+    float LightComponent::getRange() const
+    {
+        if (LightType == LightType::DIRECTIONAL)
+            return std::numeric_limits<float>::infinity();
+        // The light adds color / (a*d^2 + b*d + c), so we solve a*d^2 + b*d + c = 256 * color for d
+        float brightest = glm::max(glm::max(diffuse.r, diffuse.g), glm::max(diffuse.b, glm::max(glm::max(specular.r, specular.g), specular.b)));
+        float limit = 256.0f * brightest - attenuation.z;
+        if (limit <= 0.0f)
+            return 0.0f;
+        if (attenuation.x > 0.0f)
+            return (-attenuation.y + glm::sqrt(attenuation.y * attenuation.y + 4.0f * attenuation.x * limit)) / (2.0f * attenuation.x);
+        if (attenuation.y > 0.0f)
+            return limit / attenuation.y;
+        return std::numeric_limits<float>::infinity();
     }
 
-}
\ No newline at end of file
+}
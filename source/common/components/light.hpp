@@ -24,10 +24,15 @@ namespace our {
         glm::vec2 cone_angles; // Cone angles for spotlight type
         glm::vec3 diffuse;     // Diffuse color of the light
         glm::vec3 specular;    // Specular color of the light
+        bool castShadows = false; // Only the directional and spot lights can cast shadows (see "ShadowMaps")
         
         // Static function to get the ID of this component type
         static std::string getID() { return "Light"; } // Returns the ID as "Light"
         
+        // Returns the distance beyond which the light adds less than 1/256 of its color (so its contribution can be ignored)
+        // It is infinite for the directional lights and for the lights whose attenuation doesn't grow with the distance
+        float getRange() const;
+
         // Deserialize function to read light parameters from JSON
         void deserialize(const nlohmann::json& data) override;
     };
@@ -14,5 +14,6 @@ namespace our {
         if(!data.is_object()) return;
         this->mesh = AssetLoader<Mesh>::get(data["mesh"].get<std:: string>());
         this->material = AssetLoader<Material>::get(data["material"].get<std:: string>());
+        this->castShadows = data.value("castShadows", this->castShadows);
     }
 }
\ No newline at end of file
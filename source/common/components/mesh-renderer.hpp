@@ -12,6 +12,7 @@ namespace our {
     public:
         Mesh* mesh; // The mesh that should be drawn
         Material* material; // The material used to draw the mesh
+        bool castShadows = true; // Should the mesh be drawn into the shadow maps (only the opaque meshes can cast shadows)
 
         // The ID of this component type is "Mesh Renderer"
         static std::string getID() { return "Mesh Renderer"; }
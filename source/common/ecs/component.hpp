@@ -2,17 +2,37 @@
 
 #include <json/json.hpp>
 #include <string>
+#include <cstddef>
 
 namespace our {
 
     class Entity; // A forward declaration of the Entity Class
 
+    // A small integer that uniquely identifies each component type at runtime.
+    // It is used by the entity to store and find its components by type in O(1) without any dynamic_cast
+    using ComponentTypeId = std::size_t;
+
+    // Returns a new id every time it is called. It should only be used by "getComponentTypeId"
+    inline ComponentTypeId nextComponentTypeId() {
+        static ComponentTypeId next = 0;
+        return next++;
+    }
+
+    // Returns the id of the component type T. The id is assigned the first time this function is called for T
+    // and stays the same for the rest of the program
+    template<typename T>
+    ComponentTypeId getComponentTypeId() {
+        static const ComponentTypeId id = nextComponentTypeId();
+        return id;
+    }
+
     // A component is a data container that can be added to an entity.
     // The role of the entity in the world is defined by the components it holds.
     // For example, an entity with a camera component specifies that this entity should be used as a camera
     // Thus any renderer system should look for an entity holding a camera component in order to compute the camera related uniforms (e.g. VP matrix)
     class Component {
         Entity* owner; // A pointer to the entity that owns this component
+        ComponentTypeId typeId; // The id of the concrete type of this component (set by the entity when the component is added)
         friend Entity; // The entity is a friend since it is the only one allowed to set itself as an owner of a certain component.
     public:
         // This static method returns a unique string that identifies each type of components
@@ -24,6 +44,8 @@ namespace our {
         virtual void deserialize(const nlohmann::json& data) = 0;
         // Returns the owner of this component
         Entity* getOwner() const { return owner; }
+        // Returns the id of the concrete type of this component
+        ComponentTypeId getTypeId() const { return typeId; }
         // Define a virtual destructor
         virtual ~Component(){}
     };
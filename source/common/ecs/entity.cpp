@@ -1,4 +1,5 @@
 #include "entity.hpp"
+#include "world.hpp"
 #include "../deserialize-utils.hpp"
 #include "../components/component-deserializer.hpp"
 
@@ -10,21 +11,64 @@ namespace our {
     // Remember that you can get the transformation matrix from this entity to its parent from "localTransform"
     // To get the local to world matrix, you need to combine this entities matrix with its parent's matrix and
     // its parent's parent's matrix and so on till you reach the root.
-    glm::mat4 Entity::getLocalToWorldMatrix() const {
+    // The result is cached: the matrices are only recomputed if this entity's local transform or one of its ancestors' changed
+    const glm::mat4& Entity::getLocalToWorldMatrix() const {
         //TODO: (Req 8) Write this function
-        Entity * curr_ent= this->parent;
+        bool changed = worldVersion == 0;
 
-        glm::mat4 transformation_matrix = this->localTransform.toMat4();
-        while(curr_ent){
-            
-            transformation_matrix = curr_ent->localTransform.toMat4()*transformation_matrix;
+        // Only recompute the local matrix (and its yawPitchRoll) if the local transform changed
+        if(changed || localTransform != cachedTransform){
+            cachedTransform = localTransform;
+            cachedLocalMatrix = localTransform.toMat4();
+            changed = true;
+        }
+
+        // The parent's matrix is cached too, so walking up the hierarchy is only a few comparisons
+        if(parent){
+            const glm::mat4& parentMatrix = parent->getLocalToWorldMatrix();
+            if(changed || parent != cachedParent || parent->worldVersion != cachedParentVersion){
+                cachedWorldMatrix = parentMatrix * cachedLocalMatrix;
+                changed = true;
+            }
+            cachedParentVersion = parent->worldVersion;
+        } else if(changed || cachedParent != nullptr){
+            cachedWorldMatrix = cachedLocalMatrix;
+            changed = true;
+        }
+        cachedParent = parent;
+
+        // Let the children know that our world matrix changed
+        if(changed) worldVersion++;
+        return cachedWorldMatrix;
+    }
 
-            curr_ent = curr_ent->parent;
+    // The render matrix is the world matrix of the transform between "previousTransform" and "localTransform"
+    // Most entities don't move, so they (and their children if they don't move either) just use the cached world matrix
+    void Entity::updateRenderMatrix(float interpolation, unsigned int frame) const {
+        if(interpolationFrame == frame) return;
+        interpolationFrame = frame;
+        // This also makes sure that the cached local matrix is up to date
+        getLocalToWorldMatrix();
+        bool parentInterpolated = false;
+        if(parent){
+            parent->updateRenderMatrix(interpolation, frame);
+            parentInterpolated = parent->interpolated;
         }
-        
-        
-        
-        return transformation_matrix;
+        bool moved = interpolation < 1.0f && previousTransform != localTransform;
+        interpolated = moved || parentInterpolated;
+        if(!interpolated) return;
+        glm::mat4 localMatrix = moved ? Transform::interpolate(previousTransform, localTransform, interpolation).toMat4() : cachedLocalMatrix;
+        interpolatedWorldMatrix = parent ? parent->getRenderMatrix() * localMatrix : localMatrix;
+    }
+
+    // The world keeps cached views of the entities that have certain component types
+    // so it must know whenever an entity gains or loses a component type
+    void Entity::notifyComponentAdded(ComponentTypeId typeId){
+        if(world) world->onComponentAdded(this, typeId);
+    }
+
+    void Entity::notifyComponentRemoved(ComponentTypeId typeId){
+        if(world) world->onComponentRemoved(this, typeId);
     }
 
     // Deserializes the entity data and components from a json object
@@ -32,6 +76,7 @@ namespace our {
         if(!data.is_object()) return;
         name = data.value("name", name);
         localTransform.deserialize(data);
+        previousTransform = localTransform;
         if(data.contains("components")){
             if(const auto& components = data["components"]; components.is_array()){
                 for(auto& component: components){
@@ -2,8 +2,8 @@
 
 #include "component.hpp"
 #include "transform.hpp"
-#include <list>
-#include <iterator>
+#include <vector>
+#include <algorithm>
 #include <string>
 #include <glm/glm.hpp>
 
@@ -13,7 +13,56 @@ namespace our {
 
     class Entity{
         World *world; // This defines what world own this entity
-        std::list<Component*> components; // A list of components that are owned by this entity
+        std::vector<Component*> components; // The components owned by this entity in the order they were added
+        // The first component of each type indexed by its component type id (nullptr if the entity has no component of that type)
+        // This allows getComponent to find a component in O(1) instead of trying to dynamic_cast every component
+        std::vector<Component*> componentsByType;
+
+        // Makes "componentsByType" point to the first remaining component with the given type id (or nullptr if there is none)
+        // This is only needed when a component is removed
+        void refreshComponentByType(ComponentTypeId typeId){
+            if(typeId >= componentsByType.size()) return;
+            auto it = std::find_if(components.begin(), components.end(), [typeId](Component* component){
+                return component->typeId == typeId;
+            });
+            componentsByType[typeId] = it != components.end() ? *it : nullptr;
+        }
+
+        // Tell the world that this entity gained its first component of the given type or lost its last one
+        // so that the world can keep its cached views up to date (defined in "entity.cpp" since it needs the World class)
+        void notifyComponentAdded(ComponentTypeId typeId);
+        void notifyComponentRemoved(ComponentTypeId typeId);
+
+        // Removes the component at the given position in the components list, deletes it and updates the type table
+        void eraseComponent(std::vector<Component*>::iterator it){
+            Component* component = *it;
+            ComponentTypeId typeId = component->typeId;
+            components.erase(it);
+            if(componentsByType[typeId] == component){
+                refreshComponentByType(typeId);
+                if(componentsByType[typeId] == nullptr) notifyComponentRemoved(typeId);
+            }
+            delete component;
+        }
+
+        // The local to world matrix is cached since it is requested many times per frame (by the renderer, the lights and the game logic)
+        // The cache is recomputed only if "localTransform" changed since the last computation (the snapshot below acts as the dirty flag)
+        // or if the parent's world matrix changed (detected by comparing the parent's version with the one we saw last time)
+        mutable Transform cachedTransform; // The local transform used to compute the cached matrices
+        mutable glm::mat4 cachedLocalMatrix = glm::mat4(1.0f); // localTransform.toMat4() of the cached transform
+        mutable glm::mat4 cachedWorldMatrix = glm::mat4(1.0f); // The cached local to world matrix
+        mutable const Entity* cachedParent = nullptr; // The parent used to compute the cached world matrix
+        mutable unsigned int cachedParentVersion = 0; // The parent's worldVersion used to compute the cached world matrix
+        mutable unsigned int worldVersion = 0; // Incremented every time the cached world matrix changes (0 means not computed yet)
+
+        // The matrix used to draw the entity (see "getRenderMatrix"). It is only stored if it differs from the cached world matrix,
+        // which is the case when this entity or one of its ancestors moved during the last fixed step
+        mutable glm::mat4 interpolatedWorldMatrix = glm::mat4(1.0f);
+        mutable bool interpolated = false; // Is "interpolatedWorldMatrix" the render matrix
+        mutable unsigned int interpolationFrame = 0; // The world's transform frame in which the render matrix was last computed
+
+        // Computes the render matrix between the previous and the current fixed step (the parent's is computed first)
+        void updateRenderMatrix(float interpolation, unsigned int frame) const;
 
         friend World; // The world is a friend since it is the only class that is allowed to instantiate an entity
         Entity() = default; // The entity constructor is private since only the world is allowed to instantiate an entity
@@ -22,10 +71,19 @@ namespace our {
         Entity* parent;   // The parent of the entity. The transform of the entity is relative to its parent.
                           // If parent is null, the entity is a root entity (has no parent).
         Transform localTransform; // The transform of this entity relative to its parent.
+        Transform previousTransform; // The local transform at the start of the last fixed step (see "World::savePreviousTransforms").
+                                     // The entity is drawn between this transform and "localTransform", so systems that teleport
+                                     // an entity should set it to the new "localTransform" to avoid drawing it in between.
 
         World* getWorld() const { return world; } // Returns the world to which this entity belongs
 
-        glm::mat4 getLocalToWorldMatrix() const; // Computes and returns the transformation from the entities local space to the world space
+        const glm::mat4& getLocalToWorldMatrix() const; // Returns the (cached) transformation from the entities local space to the world space
+        // Returns a number that changes whenever the local to world matrix changes (e.g. to detect which entities never move)
+        unsigned int getTransformVersion() const { getLocalToWorldMatrix(); return worldVersion; }
+        // Returns the transformation from the entities local space to the world space as it should be drawn this frame
+        // (interpolated between the last two fixed steps). It is refreshed by "World::updateTransforms" so only renderers should use it,
+        // the game logic should use "getLocalToWorldMatrix" which always matches the current simulation step
+        const glm::mat4& getRenderMatrix() const { return interpolated ? interpolatedWorldMatrix : getLocalToWorldMatrix(); }
         void deserialize(const nlohmann::json&); // Deserializes the entity data and components from a json object
         
         // This template method create a component of type T,
@@ -40,38 +98,45 @@ namespace our {
             T *component = new T();
             // set its "owner" to be this entity
             component->owner = this;
+            component->typeId = getComponentTypeId<T>();
             // add it to the components
             this->components.push_back(component);
+            // if it is the first component of its type, remember it in the type table
+            if(component->typeId >= componentsByType.size()) componentsByType.resize(component->typeId + 1, nullptr);
+            if(componentsByType[component->typeId] == nullptr){
+                componentsByType[component->typeId] = component;
+                notifyComponentAdded(component->typeId);
+            }
             // return it.
             return component;
         }
 
+        // Returns true if this entity has at least one component with the given type id
+        bool hasComponent(ComponentTypeId typeId) const {
+            return typeId < componentsByType.size() && componentsByType[typeId] != nullptr;
+        }
+
         // This template method searhes for a component of type T and returns a pointer to it
         // If no component of type T was found, it returns a nullptr 
+        // Note: T must be the exact (most derived) type of the component since the lookup is done by type id
         template<typename T>
         T* getComponent(){
             //TODO: (Req 8) Go through the components list and find the first component that can be dynamically cast to "T*".
             // Return the component you found, or return null of nothing was found.
 
-            std::list<Component *>::iterator it;
-
-            for (it = components.begin(); it != components.end(); it++)
-            {
-                T *t = dynamic_cast<T *>(*it);
-                if (t)
-                    return t;
-            }
+            // The type table is indexed by the type id, so no search or dynamic_cast is needed
+            ComponentTypeId typeId = getComponentTypeId<T>();
+            if(typeId < componentsByType.size())
+                return static_cast<T*>(componentsByType[typeId]);
             return nullptr;
         }
 
-        // This template method dynami and returns a pointer to it
-        // If no component of type T was found, it returns a nullptr 
+        // This template method returns the component at the given index if it is of type T
+        // If the index is out of range or the component is not of type T, it returns a nullptr 
         template<typename T>
         T* getComponent(size_t index){
-            auto it = components.begin();
-            std::advance(it, index);
-            if(it != components.end())
-                return dynamic_cast<T*>(*it);
+            if(index < components.size() && components[index]->typeId == getComponentTypeId<T>())
+                return static_cast<T*>(components[index]);
             return nullptr;
         }
 
@@ -80,31 +145,14 @@ namespace our {
         void deleteComponent(){
             //TODO: (Req 8) Go through the components list and find the first component that can be dynamically cast to "T*".
             // If found, delete the found component and remove it from the components list
-
-            std::list<Component *>::iterator it;
-
-            for (it = components.begin(); it != components.end(); it++)
-            {
-                // try to find the first component that can be dynamically cast to "T*"
-                T *t = dynamic_cast<T *>(*it);
-
-                if (t)
-                {
-                    delete *it;
-                    components.erase(it);
-                    return;
-                }
-            }
+            if(T* component = getComponent<T>(); component)
+                eraseComponent(std::find(components.begin(), components.end(), component));
         }
 
         // This template method searhes for a component of type T and deletes it
         void deleteComponent(size_t index){
-            auto it = components.begin();
-            std::advance(it, index);
-            if(it != components.end()) {
-                delete *it;
-                components.erase(it);
-            }
+            if(index < components.size())
+                eraseComponent(components.begin() + index);
         }
 
         // This template method searhes for the given component and deletes it
@@ -112,30 +160,22 @@ namespace our {
         void deleteComponent(T const* component){
             //TODO: (Req 8) Go through the components list and find the given component "component".
             // If found, delete the found component and remove it from the components list
-
-            std::list<Component *>::iterator it;
-
-            for (it = components.begin(); it != components.end(); it++)
-            {
-                if (component == *it)
-                    delete *it;
-                components.erase(it);
-            }
+            if(auto it = std::find(components.begin(), components.end(), component); it != components.end())
+                eraseComponent(it);
         }
 
         // Since the entity owns its components, they should be deleted alongside the entity
         ~Entity(){
             // TODO: (Req 8) Delete all the components in "components".
 
-            std::list<Component *>::iterator it;
-
-            for (it = components.begin(); it != components.end(); it++)
+            for (auto component : components)
             {
                 // delete each pointer
-                delete *it;
+                delete component;
             }
             // clear all components
             components.clear();
+            componentsByType.clear();
         }
 
         // Entities should not be copyable
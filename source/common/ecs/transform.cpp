@@ -2,6 +2,7 @@
 #include "../deserialize-utils.hpp"
 
 #include <glm/gtx/euler_angles.hpp>
+#include <glm/gtc/constants.hpp>
 
 namespace our {
 
@@ -19,6 +20,16 @@ namespace our {
         return transformMatrix;  
     }
 
+    Transform Transform::interpolate(const Transform& from, const Transform& to, float t){
+        Transform result;
+        result.position = glm::mix(from.position, to.position, t);
+        glm::vec3 rotationDelta = to.rotation - from.rotation;
+        rotationDelta -= glm::two_pi<float>() * glm::round(rotationDelta / glm::two_pi<float>());
+        result.rotation = from.rotation + rotationDelta * t;
+        result.scale = glm::mix(from.scale, to.scale, t);
+        return result;
+    }
+
      // Deserializes the entity data and components from a json object
     void Transform::deserialize(const nlohmann::json& data){
         position = data.value("position", position);
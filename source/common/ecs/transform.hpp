@@ -14,6 +14,15 @@ namespace our {
 
         // This function computes and returns a matrix that represents this transform
         glm::mat4 toMat4() const;
+        // Two transforms are equal if they have the same position, rotation and scale
+        // This is used to detect if a transform changed since its matrix was last computed
+        bool operator==(const Transform& other) const {
+            return position == other.position && rotation == other.rotation && scale == other.scale;
+        }
+        bool operator!=(const Transform& other) const { return !(*this == other); }
+        // Returns the transform between "from" (t = 0) and "to" (t = 1)
+        // Each euler angle takes the shortest way around the circle, so a wrapped angle (e.g. from 2*PI to 0) doesn't spin the object
+        static Transform interpolate(const Transform& from, const Transform& to, float t);
          // Deserializes the entity data and components from a json object
         void deserialize(const nlohmann::json&);
     };
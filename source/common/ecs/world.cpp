@@ -12,6 +12,8 @@ namespace our {
             Entity *ent= add();
             ent->parent = parent;
             ent->deserialize(entityData);
+            // Now that the entity has its name, we add it to the name index
+            entitiesByName[ent->name].push_back(ent);
 
             
             if(entityData.contains("children")){
@@ -23,4 +25,51 @@ namespace our {
         }
     }
 
-}
\ No newline at end of file
+    // Returns the view that requires exactly the given sorted type ids
+    // If it doesn't exist yet, it is created and filled by checking every entity in the order they were added
+    World::View& World::getView(const ComponentTypeId* types, size_t count){
+        for(auto& view : views){
+            if(view->types.size() == count && std::equal(view->types.begin(), view->types.end(), types))
+                return *view;
+        }
+        auto view = std::make_unique<View>();
+        view->types.assign(types, types + count);
+        for(auto entity : orderedEntities){
+            bool matches = std::all_of(view->types.begin(), view->types.end(), [entity](ComponentTypeId typeId){
+                return entity->hasComponent(typeId);
+            });
+            if(matches) view->entities.push_back(entity);
+        }
+        views.push_back(std::move(view));
+        return *views.back();
+    }
+
+    // When an entity gets its first component of a type, it may start matching the views that require that type
+    void World::onComponentAdded(Entity* entity, ComponentTypeId typeId){
+        for(auto& view : views){
+            if(std::find(view->types.begin(), view->types.end(), typeId) == view->types.end()) continue;
+            bool matches = std::all_of(view->types.begin(), view->types.end(), [entity](ComponentTypeId type){
+                return entity->hasComponent(type);
+            });
+            // Since the entity didn't have this type before, it can't already be in the view
+            if(matches) view->entities.push_back(entity);
+        }
+    }
+
+    // When an entity loses its last component of a type, it no longer matches the views that require that type
+    void World::onComponentRemoved(Entity* entity, ComponentTypeId typeId){
+        for(auto& view : views){
+            if(std::find(view->types.begin(), view->types.end(), typeId) == view->types.end()) continue;
+            if(auto it = std::find(view->entities.begin(), view->entities.end(), entity); it != view->entities.end())
+                view->entities.erase(it);
+        }
+    }
+
+    void World::removeFromViews(Entity* entity){
+        for(auto& view : views){
+            if(auto it = std::find(view->entities.begin(), view->entities.end(), entity); it != view->entities.end())
+                view->entities.erase(it);
+        }
+    }
+
+}
@@ -1,6 +1,11 @@
 #pragma once
 
 #include <unordered_set>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
 #include "entity.hpp"
 
 namespace our {
@@ -8,8 +13,38 @@ namespace our {
     // This class holds a set of entities
     class World {
         std::unordered_set<Entity*> entities; // These are the entities held by this world
+        std::vector<Entity*> orderedEntities; // The same entities in the order they were added (used to fill new views deterministically)
         std::unordered_set<Entity*> markedForRemoval; // These are the entities that are awaiting to be deleted
                                                       // when deleteMarkedEntities is called
+        // The entities grouped by name, so that systems can find entities by name without comparing strings every frame
+        // Keys are never erased, so a reference returned by "findAllByName" stays valid for the lifetime of the world
+        std::unordered_map<std::string, std::vector<Entity*>> entitiesByName;
+        // Incremented whenever entities are added, removed or renamed. Systems that cache entity pointers
+        // can compare it with the version they saw last time to know if they need to look the entities up again
+        unsigned int version = 0;
+        // Incremented whenever the render matrices are refreshed (see "updateTransforms")
+        unsigned int transformFrame = 0;
+
+        // A view is a cached list of the entities that have at least one component of each of the given types
+        // The entities are stored in the order in which they started matching the view
+        struct View {
+            std::vector<ComponentTypeId> types; // The (sorted) component type ids required by this view
+            std::vector<Entity*> entities; // The entities that currently match the view
+        };
+        // The views are kept alive (and up to date) until the world is destroyed,
+        // so the references returned by "view" stay valid. They are stored as pointers since their addresses must not change.
+        std::vector<std::unique_ptr<View>> views;
+
+        friend Entity; // The entity notifies the world whenever it gains or loses a component type
+
+        // Returns the view that requires exactly the given sorted type ids (creating and filling it if it doesn't exist)
+        View& getView(const ComponentTypeId* types, size_t count);
+        // Called by an entity when it gets its first component of the given type
+        void onComponentAdded(Entity* entity, ComponentTypeId typeId);
+        // Called by an entity when it loses its last component of the given type
+        void onComponentRemoved(Entity* entity, ComponentTypeId typeId);
+        // Removes the given entity from every view that contains it
+        void removeFromViews(Entity* entity);
     public:
 
         World() = default;
@@ -29,14 +64,78 @@ namespace our {
             Entity* ent = new Entity();
             ent->world = this;
             entities.insert(ent);
+            orderedEntities.push_back(ent);
+            version++;
             return ent;
         }
 
+        // Changes the name of the given entity and updates the name index
+        // Use this (instead of assigning "name" directly) for entities that are already in the world
+        void setName(Entity* entity, const std::string& name){
+            auto& oldGroup = entitiesByName[entity->name];
+            oldGroup.erase(std::remove(oldGroup.begin(), oldGroup.end(), entity), oldGroup.end());
+            entity->name = name;
+            entitiesByName[name].push_back(entity);
+            version++;
+        }
+
+        // Returns the first entity (in the order they were added) with the given name or nullptr if none exists
+        Entity* findByName(const std::string& name){
+            const auto& group = findAllByName(name);
+            return group.empty() ? nullptr : group.front();
+        }
+
+        // Returns all the entities with the given name (in the order they were added)
+        // The returned reference stays valid and up to date as entities are added or removed
+        const std::vector<Entity*>& findAllByName(const std::string& name){
+            return entitiesByName[name];
+        }
+
+        // Returns a number that changes whenever entities are added, removed or renamed
+        unsigned int getVersion() const {
+            return version;
+        }
+
         // This returns and immutable reference to the set of all entites in the world.
         const std::unordered_set<Entity*>& getEntities() {
             return entities;
         }
 
+        // This returns the entities that have at least one component of each of the given types
+        // For example: "view<CameraComponent, FreeCameraControllerComponent>()"
+        // The view is built the first time it is requested, then it is updated incrementally whenever components are added or removed
+        // so systems only iterate over the entities they care about (in a deterministic order).
+        // WARNING: Don't add or remove components of the viewed types while iterating over the returned view.
+        template<typename... Ts>
+        const std::vector<Entity*>& view() {
+            static_assert(sizeof...(Ts) > 0, "A view needs at least one component type");
+            static_assert((std::is_base_of<Component, Ts>::value && ...), "Ts must inherit from Component");
+            ComponentTypeId types[] = { getComponentTypeId<Ts>()... };
+            std::sort(std::begin(types), std::end(types));
+            return getView(types, sizeof...(Ts)).entities;
+        }
+
+        // This refreshes the cached local to world matrix of every entity in one pass (in the order they were added)
+        // A child may come before its parent in that order, so refreshing an entity first refreshes its parent (recursively)
+        // It should be called once per frame after the systems moved the entities, so that the following calls
+        // to "getLocalToWorldMatrix" only read the cache
+        // The render matrices are refreshed too: "interpolation" is how far the frame is between the previous fixed step (0) and the current one (1)
+        void updateTransforms(float interpolation = 1.0f){
+            transformFrame++;
+            for(auto entity : orderedEntities){
+                entity->updateRenderMatrix(interpolation, transformFrame);
+            }
+        }
+
+        // This remembers the local transform of every entity as its "previousTransform"
+        // It should be called at the start of every fixed step (before the systems move the entities),
+        // so that the frames drawn until the next step can be interpolated between the two steps
+        void savePreviousTransforms(){
+            for(auto entity : orderedEntities){
+                entity->previousTransform = entity->localTransform;
+            }
+        }
+
         // This marks an entity for removal by adding it to the "markedForRemoval" set.
         // The elements in the "markedForRemoval" set will be removed and deleted when "deleteMarkedEntities" is called.
         void markForRemoval(Entity* entity){
@@ -50,14 +149,22 @@ namespace our {
         // Then each of these elements are deleted.
         void deleteMarkedEntities(){
             //TODO: (Req 8) Remove and delete all the entities that have been marked for removal
+            if(markedForRemoval.empty()) return;
+            orderedEntities.erase(std::remove_if(orderedEntities.begin(), orderedEntities.end(), [this](Entity* ent){
+                return markedForRemoval.count(ent) != 0;
+            }), orderedEntities.end());
             for (auto ent : markedForRemoval)
             {
                 entities.erase(ent);
+                removeFromViews(ent);
+                auto& group = entitiesByName[ent->name];
+                group.erase(std::remove(group.begin(), group.end(), ent), group.end());
 
                 delete ent;
             }
-            
+
             markedForRemoval.clear();
+            version++;
         }
 
         //This deletes all entities in the world
@@ -67,7 +174,16 @@ namespace our {
                 delete ent;
             }
             entities.clear();
+            orderedEntities.clear();
             markedForRemoval.clear();
+            for(auto& [name, group] : entitiesByName){
+                group.clear();
+            }
+            version++;
+            // The views are kept (since systems may hold references to them) but they become empty
+            for(auto& view : views){
+                view->entities.clear();
+            }
         }
 
         //Since the world owns all of its entities, they should be deleted alongside it.
@@ -80,4 +196,4 @@ namespace our {
         World &operator=(World const &) = delete;
     };
 
-}
\ No newline at end of file
+}
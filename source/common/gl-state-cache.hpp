@@ -0,0 +1,207 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/vec4.hpp>
+#include <array>
+
+#include "profiler.hpp"
+
+namespace our {
+
+    // This static class keeps a copy of the OpenGL state that changes often while drawing
+    // (capabilities, depth/blend/cull options, masks, the used program and the texture & sampler bindings)
+    // so that setting a value that is already set does not reach the driver.
+    // WARNING: Any code that changes this state with raw OpenGL calls must either go through this class or call "invalidate".
+    // The application invalidates the cache every frame before drawing since ImGui changes the state behind its back.
+    // Every call that reaches OpenGL is counted as a state change by the "Profiler".
+    class GLStateCache {
+        // A value that never matches a real value so that the next call always reaches OpenGL
+        static constexpr GLuint UNKNOWN = ~GLuint(0);
+        static constexpr GLuint MAX_TEXTURE_UNITS = 16;
+
+        static inline GLuint cullFaceEnabled = UNKNOWN, depthTestEnabled = UNKNOWN, blendEnabled = UNKNOWN;
+        static inline GLenum culledFace = UNKNOWN, frontFaceWinding = UNKNOWN, depthFunction = UNKNOWN;
+        static inline GLenum blendEquationMode = UNKNOWN, blendSource = UNKNOWN, blendDestination = UNKNOWN;
+        static inline glm::vec4 blendConstantColor = {-1, -1, -1, -1}; // Colors are clamped to [0, 1] so this never matches
+        static inline GLuint colorMaskBits = UNKNOWN, depthMaskEnabled = UNKNOWN;
+        static inline GLuint program = UNKNOWN;
+        static inline GLuint activeTextureUnit = UNKNOWN;
+        using UnitBindings = std::array<GLuint, MAX_TEXTURE_UNITS>; // The object bound to each texture unit
+        static constexpr UnitBindings unknownBindings() {
+            UnitBindings bindings{};
+            for(auto& binding : bindings) binding = UNKNOWN;
+            return bindings;
+        }
+        static inline UnitBindings textures = unknownBindings();
+        static inline UnitBindings textureArrays = unknownBindings();
+        static inline UnitBindings textureBuffers = unknownBindings();
+        static inline UnitBindings samplers = unknownBindings();
+        // The framebuffer that stands for the window (it is not a cached binding, so "invalidate" keeps it)
+        static inline GLuint defaultFramebuffer = 0;
+
+        // Returns the cached enabled flag of the given capability or nullptr if the capability is not cached
+        static GLuint* getCapability(GLenum capability) {
+            switch(capability){
+                case GL_CULL_FACE: return &cullFaceEnabled;
+                case GL_DEPTH_TEST: return &depthTestEnabled;
+                case GL_BLEND: return &blendEnabled;
+                default: return nullptr;
+            }
+        }
+
+    public:
+        // Forgets everything, so the next call of every function reaches OpenGL
+        static void invalidate() {
+            cullFaceEnabled = depthTestEnabled = blendEnabled = UNKNOWN;
+            culledFace = frontFaceWinding = depthFunction = UNKNOWN;
+            blendEquationMode = blendSource = blendDestination = UNKNOWN;
+            blendConstantColor = {-1, -1, -1, -1};
+            colorMaskBits = depthMaskEnabled = UNKNOWN;
+            program = UNKNOWN;
+            activeTextureUnit = UNKNOWN;
+            textures = textureArrays = textureBuffers = samplers = unknownBindings();
+        }
+
+        // Same as glEnable/glDisable
+        static void setEnabled(GLenum capability, bool enabled) {
+            GLuint* cached = getCapability(capability);
+            if(cached && *cached == GLuint(enabled)) return;
+            Profiler::count(ProfileCounter::StateChanges);
+            if(enabled) glEnable(capability); else glDisable(capability);
+            if(cached) *cached = enabled;
+        }
+
+        static void cullFace(GLenum face) {
+            if(culledFace == face) return;
+            Profiler::count(ProfileCounter::StateChanges);
+            glCullFace(culledFace = face);
+        }
+
+        static void frontFace(GLenum winding) {
+            if(frontFaceWinding == winding) return;
+            Profiler::count(ProfileCounter::StateChanges);
+            glFrontFace(frontFaceWinding = winding);
+        }
+
+        static void depthFunc(GLenum function) {
+            if(depthFunction == function) return;
+            Profiler::count(ProfileCounter::StateChanges);
+            glDepthFunc(depthFunction = function);
+        }
+
+        static void blendEquation(GLenum equation) {
+            if(blendEquationMode == equation) return;
+            Profiler::count(ProfileCounter::StateChanges);
+            glBlendEquation(blendEquationMode = equation);
+        }
+
+        static void blendFunc(GLenum source, GLenum destination) {
+            if(blendSource == source && blendDestination == destination) return;
+            Profiler::count(ProfileCounter::StateChanges);
+            glBlendFunc(blendSource = source, blendDestination = destination);
+        }
+
+        static void blendColor(const glm::vec4& color) {
+            if(blendConstantColor == color) return;
+            blendConstantColor = color;
+            Profiler::count(ProfileCounter::StateChanges);
+            glBlendColor(color.r, color.g, color.b, color.a);
+        }
+
+        static void colorMask(const glm::bvec4& mask) {
+            GLuint bits = GLuint(mask.r) | (GLuint(mask.g) << 1) | (GLuint(mask.b) << 2) | (GLuint(mask.a) << 3);
+            if(colorMaskBits == bits) return;
+            colorMaskBits = bits;
+            Profiler::count(ProfileCounter::StateChanges);
+            glColorMask(mask.r, mask.g, mask.b, mask.a);
+        }
+
+        static void depthMask(bool enabled) {
+            if(depthMaskEnabled == GLuint(enabled)) return;
+            depthMaskEnabled = enabled;
+            Profiler::count(ProfileCounter::StateChanges);
+            glDepthMask(enabled);
+        }
+
+        // Same as glUseProgram
+        static void useProgram(GLuint name) {
+            if(program == name) return;
+            Profiler::count(ProfileCounter::StateChanges);
+            glUseProgram(program = name);
+        }
+
+        // Same as glActiveTexture but it takes the unit index (e.g. 0 instead of GL_TEXTURE0)
+        static void activeTexture(GLuint unit) {
+            if(activeTextureUnit == unit) return;
+            Profiler::count(ProfileCounter::StateChanges);
+            glActiveTexture(GL_TEXTURE0 + (activeTextureUnit = unit));
+        }
+
+        // Same as glBindTexture(GL_TEXTURE_2D, name) on the active texture unit
+        static void bindTexture2D(GLuint name) {
+            if(activeTextureUnit < MAX_TEXTURE_UNITS){
+                if(textures[activeTextureUnit] == name) return;
+                textures[activeTextureUnit] = name;
+            } else {
+                // We don't know which unit is active, so we can't trust any of the texture bindings anymore
+                textures = unknownBindings();
+            }
+            Profiler::count(ProfileCounter::StateChanges);
+            glBindTexture(GL_TEXTURE_2D, name);
+        }
+
+        // Same as glBindTexture(GL_TEXTURE_2D_ARRAY, name) on the active texture unit
+        static void bindTexture2DArray(GLuint name) {
+            if(activeTextureUnit < MAX_TEXTURE_UNITS){
+                if(textureArrays[activeTextureUnit] == name) return;
+                textureArrays[activeTextureUnit] = name;
+            } else {
+                textureArrays = unknownBindings();
+            }
+            Profiler::count(ProfileCounter::StateChanges);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, name);
+        }
+
+        // Same as glBindTexture(GL_TEXTURE_BUFFER, name) on the active texture unit
+        static void bindTextureBuffer(GLuint name) {
+            if(activeTextureUnit < MAX_TEXTURE_UNITS){
+                if(textureBuffers[activeTextureUnit] == name) return;
+                textureBuffers[activeTextureUnit] = name;
+            } else {
+                textureBuffers = unknownBindings();
+            }
+            Profiler::count(ProfileCounter::StateChanges);
+            glBindTexture(GL_TEXTURE_BUFFER, name);
+        }
+
+        // Same as glBindSampler
+        static void bindSampler(GLuint unit, GLuint name) {
+            if(unit < MAX_TEXTURE_UNITS){
+                if(samplers[unit] == name) return;
+                samplers[unit] = name;
+            }
+            Profiler::count(ProfileCounter::StateChanges);
+            glBindSampler(unit, name);
+        }
+
+        // The framebuffer to draw to instead of 0 when drawing to the window
+        // It is 0 unless the application renders offscreen (e.g. when benchmarking with a hidden window)
+        static void setDefaultFramebuffer(GLuint name) { defaultFramebuffer = name; }
+        static GLuint getDefaultFramebuffer() { return defaultFramebuffer; }
+
+        // These should be called when an object is deleted since OpenGL unbinds it
+        // (and its name could be reused by a new object that is not bound yet)
+        static void forgetProgram(GLuint name) {
+            if(program == name) program = UNKNOWN;
+        }
+        static void forgetTexture(GLuint name) {
+            for(auto& texture : textures) if(texture == name) texture = UNKNOWN;
+            for(auto& texture : textureArrays) if(texture == name) texture = UNKNOWN;
+            for(auto& texture : textureBuffers) if(texture == name) texture = UNKNOWN;
+        }
+        static void forgetSampler(GLuint name) {
+            for(auto& sampler : samplers) if(sampler == name) sampler = UNKNOWN;
+        }
+    };
+
+}
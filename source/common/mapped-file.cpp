@@ -0,0 +1,53 @@
+#include "mapped-file.hpp"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+our::MappedFile::MappedFile(const std::string& path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE) return;
+    fileHandle = file;
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return;
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping == nullptr) return;
+    mappingHandle = mapping;
+    data = static_cast<const std::uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if(data) size = (size_t)fileSize.QuadPart;
+}
+
+our::MappedFile::~MappedFile() {
+    if(data) UnmapViewOfFile(data);
+    if(mappingHandle) CloseHandle(mappingHandle);
+    if(fileHandle) CloseHandle(fileHandle);
+}
+
+#else
+
+our::MappedFile::MappedFile(const std::string& path) {
+    fileDescriptor = open(path.c_str(), O_RDONLY);
+    if(fileDescriptor < 0) return;
+    struct stat status;
+    if(fstat(fileDescriptor, &status) != 0 || status.st_size == 0) return;
+    void* mapped = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if(mapped == MAP_FAILED) return;
+    data = static_cast<const std::uint8_t*>(mapped);
+    size = (size_t)status.st_size;
+}
+
+our::MappedFile::~MappedFile() {
+    if(data) munmap(const_cast<std::uint8_t*>(data), size);
+    if(fileDescriptor >= 0) close(fileDescriptor);
+}
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace our {
+
+    // A read-only view of a whole file mapped into memory
+    // The operating system reads the pages on demand, so the data can be passed directly to OpenGL without copying it first
+    class MappedFile {
+        const std::uint8_t* data = nullptr;
+        size_t size = 0;
+#if defined(_WIN32)
+        void* fileHandle = nullptr;
+        void* mappingHandle = nullptr;
+#else
+        int fileDescriptor = -1;
+#endif
+    public:
+        // Maps the given file. If it fails (e.g. the file doesn't exist or is empty), "isOpen" returns false
+        explicit MappedFile(const std::string& path);
+        ~MappedFile();
+
+        bool isOpen() const { return data != nullptr; }
+        const std::uint8_t* getData() const { return data; }
+        size_t getSize() const { return size; }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+    };
+
+    // Returns the 64-bit FNV-1a hash of the given bytes
+    inline std::uint64_t hashBytes(const void* bytes, size_t count, std::uint64_t hash = 14695981039346656037ull) {
+        const std::uint8_t* data = static_cast<const std::uint8_t*>(bytes);
+        for(size_t index = 0; index < count; index++){
+            hash ^= data[index];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+}
@@ -3,15 +3,17 @@
 #include "../asset-loader.hpp"
 #include "deserialize-utils.hpp"
 
+#include <iostream>
+
 namespace our
 {
 
     // This function should setup the pipeline state and set the shader to be used
-    void Material::setup() const
+    void Material::setup(bool instanced) const
     {
         // TODO: (Req 7) Write this function
         pipelineState.setup();
-        if (shader)
+        if (ShaderProgram *shader = getShader(instanced))
         {
             shader->use();
         }
@@ -27,16 +29,30 @@ namespace our
         {
             pipelineState.deserialize(data["pipelineState"]);
         }
-        shader = AssetLoader<ShaderProgram>::get(data["shader"].get<std::string>());
+        shaderVariants = AssetLoader<ShaderVariants>::get(data["shader"].get<std::string>());
+        instancedShaderVariants = AssetLoader<ShaderVariants>::get(data.value("instancedShader", ""));
         transparent = data.value("transparent", false);
     }
 
+    void Material::selectShaders()
+    {
+        // Only the variants that the material uses are compiled
+        shader = shaderVariants ? shaderVariants->get(getShaderKeywords(*shaderVariants)) : nullptr;
+        instancedShader = nullptr;
+        if (instancedShaderVariants)
+        {
+            std::uint32_t instanced = instancedShaderVariants->getKeyword("INSTANCED");
+            instancedShader = instancedShaderVariants->get(getShaderKeywords(*instancedShaderVariants) | instanced);
+        }
+    }
+
     // This function should call the setup of its parent and
     // set the "tint" uniform to the value in the member variable tint
-    void TintedMaterial::setup() const
+    void TintedMaterial::setup(bool instanced) const
     {
         // TODO: (Req 7) Write this function
-        Material::setup();
+        Material::setup(instanced);
+        ShaderProgram *shader = getShader(instanced);
         if (shader)
         {
             shader->set("tint", tint);
@@ -55,16 +71,22 @@ namespace our
     // This function should call the setup of its parent and
     // set the "alphaThreshold" uniform to the value in the member variable alphaThreshold
     // Then it should bind the texture and sampler to a texture unit and send the unit number to the uniform variable "tex"
-    void TexturedMaterial::setup() const
+    void TexturedMaterial::setup(bool instanced) const
     {
         // TODO: (Req 7) Write this function
-        TintedMaterial::setup();
+        TintedMaterial::setup(instanced);
+        ShaderProgram *shader = getShader(instanced);
         if (shader)
         {
             shader->set("alphaThreshold", alphaThreshold);
         }
-        glActiveTexture(GL_TEXTURE0); // assume texture of unit 0
-        if (texture && sampler)
+        GLStateCache::activeTexture(0); // assume texture of unit 0
+        if (textureArray && sampler)
+        {
+            textureArray->bind();
+            sampler->bind(0);
+        }
+        else if (texture && sampler)
         {
             texture->bind();
             sampler->bind(0);
@@ -72,6 +94,8 @@ namespace our
         if (shader)
         {
             shader->set("tex", 0);
+            if (textureArray)
+                shader->set("layer", (GLfloat)layer);
         }
     }
 
@@ -84,14 +108,32 @@ namespace our
         alphaThreshold = data.value("alphaThreshold", 0.0f);
         texture = AssetLoader<Texture2D>::get(data.value("texture", ""));
         sampler = AssetLoader<Sampler>::get(data.value("sampler", ""));
+        // A layer of a texture array can be used instead of a texture: { "textureArray": array_name, "layer": layer_name }
+        textureArray = AssetLoader<TextureArray>::get(data.value("textureArray", ""));
+        if (textureArray)
+        {
+            std::string layerName = data.value("layer", "");
+            layer = textureArray->getLayer(layerName);
+            if (layer < 0)
+            {
+                std::cerr << "Texture array layer \"" << layerName << "\" was not found" << std::endl;
+                layer = 0;
+            }
+        }
     }
 
-    void LightMaterial::setup() const
+    std::uint32_t TexturedMaterial::getShaderKeywords(const ShaderVariants &variants) const
     {
-        Material::setup();
+        return alphaThreshold > 0.0f ? variants.getKeyword("ALPHA_TEST") : 0u;
+    }
+
+    void LightMaterial::setup(bool instanced) const
+    {
+        Material::setup(instanced);
+        ShaderProgram *shader = getShader(instanced);
         if (this->albedo) {
             // activate the texture unit 0
-            glActiveTexture(GL_TEXTURE0);
+            GLStateCache::activeTexture(0);
             // bind the texture
             this->albedo->bind();
             // bind the sampler
@@ -102,7 +144,7 @@ namespace our
 
         if (this->specular) {
             // activate the texture unit 1
-            glActiveTexture(GL_TEXTURE1);
+            GLStateCache::activeTexture(1);
             // bind the texture
             this->specular->bind();
             // bind the sampler
@@ -112,7 +154,7 @@ namespace our
         }
         if (this->emissive) {
             // activate the texture unit 2
-            glActiveTexture(GL_TEXTURE2);
+            GLStateCache::activeTexture(2);
             // bind the texture
             this->emissive->bind();
             // bind the sampler
@@ -123,7 +165,7 @@ namespace our
         if (this->roughness)
         {
             // activate the texture unit 3
-            glActiveTexture(GL_TEXTURE3);
+            GLStateCache::activeTexture(3);
             // bind the texture
             this->roughness->bind();
             // bind the sampler
@@ -134,7 +176,7 @@ namespace our
         if (this->ambient_occlusion)
         {
             // activate the texture unit 4
-            glActiveTexture(GL_TEXTURE4);
+            GLStateCache::activeTexture(4);
             // bind the texture
             this->ambient_occlusion->bind();
             // bind the sampler
@@ -158,5 +200,15 @@ namespace our
         ambient_occlusion = AssetLoader<Texture2D>::get(data.value("ambient_occlusion", ""));
     }
 
+    std::uint32_t LightMaterial::getShaderKeywords(const ShaderVariants &variants) const
+    {
+        std::uint32_t keywords = 0;
+        if (emissive)
+            keywords |= variants.getKeyword("HAS_EMISSIVE");
+        if (ambient_occlusion)
+            keywords |= variants.getKeyword("HAS_AO");
+        return keywords;
+    }
+
 
 }
\ No newline at end of file
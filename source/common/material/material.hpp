@@ -2,8 +2,10 @@
 
 #include "pipeline-state.hpp"
 #include "../texture/texture2d.hpp"
+#include "../texture/texture-array.hpp"
 #include "../texture/sampler.hpp"
 #include "../shader/shader.hpp"
+#include "../shader/shader-variants.hpp"
 
 #include <glm/vec4.hpp>
 #include <json/json.hpp>
@@ -22,12 +24,31 @@ namespace our
     public:
         PipelineState pipelineState;
         ShaderProgram *shader;
+        // An optional variant of the shader that reads the model matrices from per-instance vertex attributes
+        // If it exists, the renderer can draw many objects sharing this material (and a mesh) using a single instanced draw call
+        ShaderProgram *instancedShader = nullptr;
         bool transparent;
+        // The shader families named by the material data. The shaders above are picked from them by "selectShaders"
+        ShaderVariants *shaderVariants = nullptr, *instancedShaderVariants = nullptr;
 
         // This function does 2 things: setup the pipeline state and set the shader program to be used
-        virtual void setup() const;
+        // If "instanced" is true, the instanced shader is used (the material must have one)
+        virtual void setup(bool instanced = false) const;
         // This function read a material from a json object
         virtual void deserialize(const nlohmann::json &data);
+        // Returns the OpenGL name of the main texture of the material (or 0 if it has no textures)
+        // It is used by the renderer to draw the objects that share a texture one after the other
+        virtual GLuint getSortTexture() const { return 0; }
+        // Picks the variants of the shader and the instanced shader that fit this material (it must be called after "deserialize")
+        // The instanced shader is the "INSTANCED" variant of its family (the same family as the shader is fine)
+        void selectShaders();
+
+    protected:
+        // Returns the keywords of the variant that fits this material's data in the given shader family
+        // The keywords that the family doesn't declare are ignored, so a material works with any shader
+        virtual std::uint32_t getShaderKeywords(const ShaderVariants &) const { return 0; }
+        // Returns the shader used by "setup" for the given mode
+        ShaderProgram *getShader(bool instanced) const { return instanced ? instancedShader : shader; }
     };
 
     // This material adds a uniform for a tint (a color that will be sent to the shader)
@@ -37,7 +58,7 @@ namespace our
     public:
         glm::vec4 tint;
 
-        void setup() const override;
+        void setup(bool instanced = false) const override;
         void deserialize(const nlohmann::json &data) override;
     };
 
@@ -46,15 +67,27 @@ namespace our
     // - "tex" which is a Sampler2D. "texture" and "sampler" will be bound to it.
     // - "alphaThreshold" which defined the alpha limit below which the pixel should be discarded
     // An example where this material can be used is when the object has a texture
+    // Instead of a texture, the material can use a layer of a texture array (then, its shader must read "tex" as a sampler2DArray
+    // and the layer from the uniform "layer"). The materials that use the same array can be drawn without binding any other texture
     class TexturedMaterial : public TintedMaterial
     {
     public:
         Texture2D *texture;
         Sampler *sampler;
         float alphaThreshold;
+        TextureArray *textureArray = nullptr;
+        int layer = 0;
 
-        void setup() const override;
+        void setup(bool instanced = false) const override;
         void deserialize(const nlohmann::json &data) override;
+        // The pixels below the alpha threshold are only discarded by the "ALPHA_TEST" variant (discarding disables the early depth test)
+        std::uint32_t getShaderKeywords(const ShaderVariants &variants) const override;
+        GLuint getSortTexture() const override
+        {
+            if (textureArray)
+                return textureArray->getOpenGLName();
+            return texture ? texture->getOpenGLName() : 0;
+        }
     };
 
     class LightMaterial : public Material {
@@ -66,8 +99,11 @@ namespace our
         Texture2D* ambient_occlusion;
         Sampler* sampler;
 
-        void setup() const override;
+        void setup(bool instanced = false) const override;
         void deserialize(const nlohmann::json& data) override;
+        // The optional maps ("HAS_EMISSIVE", "HAS_AO") are only sampled by the variants of the materials that have them
+        std::uint32_t getShaderKeywords(const ShaderVariants &variants) const override;
+        GLuint getSortTexture() const override { return albedo ? albedo->getOpenGLName() : 0; }
     };
 
     // This function returns a new material instance based on the given type
@@ -1,8 +1,24 @@
 #include "pipeline-state.hpp"
 #include "../deserialize-utils.hpp"
 
+#include <glm/vector_relational.hpp>
+
 namespace our {
 
+    // Packs the options that change the most between opaque materials into 12 bits
+    std::uint32_t PipelineState::getSortKey() const {
+        std::uint32_t key = 0;
+        key |= std::uint32_t(faceCulling.enabled) << 0;
+        key |= std::uint32_t(faceCulling.culledFace == GL_FRONT ? 1 : faceCulling.culledFace == GL_BACK ? 2 : 3) << 1;
+        key |= std::uint32_t(faceCulling.frontFace == GL_CW) << 3;
+        key |= std::uint32_t(depthTesting.enabled) << 4;
+        key |= std::uint32_t(depthTesting.function - GL_NEVER) << 5; // The comparison functions are consecutive (GL_NEVER to GL_ALWAYS)
+        key |= std::uint32_t(blending.enabled) << 8;
+        key |= std::uint32_t(depthMask) << 9;
+        key |= std::uint32_t(glm::all(colorMask)) << 10;
+        return key & 0xFFF;
+    }
+
     // Given a json object, this function deserializes a PipelineState structure
     void PipelineState::deserialize(const nlohmann::json& data){
         // If the given json data does not represent a json object, return
@@ -2,7 +2,9 @@
 
 #include <glad/gl.h>
 #include <glm/vec4.hpp>
+#include <cstdint>
 #include <json/json.hpp>
+#include "../gl-state-cache.hpp"
 
 namespace our {
     // There are some options in the render pipeline that we cannot control via shaders
@@ -40,40 +42,39 @@ namespace our {
 
         // This function should set the OpenGL options to the values specified by this structure
         // For example, if faceCulling.enabled is true, you should call glEnable(GL_CULL_FACE), otherwise, you should call glDisable(GL_CULL_FACE)
+        // The calls go through the GLStateCache, so only the options that differ from the current OpenGL state reach the driver
         void setup() const {
             //TODO: (Req 4) Write this function
             // Enable or disable face culling based on the provided options
+            GLStateCache::setEnabled(GL_CULL_FACE, faceCulling.enabled);
             if (faceCulling.enabled) {
-                glEnable(GL_CULL_FACE);
-                glCullFace(faceCulling.culledFace);
-                glFrontFace(faceCulling.frontFace);
-            } else {
-                glDisable(GL_CULL_FACE);
+                GLStateCache::cullFace(faceCulling.culledFace);
+                GLStateCache::frontFace(faceCulling.frontFace);
             }
 
             // Enable or disable depth testing based on the provided options
+            GLStateCache::setEnabled(GL_DEPTH_TEST, depthTesting.enabled);
             if (depthTesting.enabled) {
-                glEnable(GL_DEPTH_TEST);
-                glDepthFunc(depthTesting.function);
-            } else {
-                glDisable(GL_DEPTH_TEST);
+                GLStateCache::depthFunc(depthTesting.function);
             }
 
             // Enable or disable blending based on the provided options
+            GLStateCache::setEnabled(GL_BLEND, blending.enabled);
             if (blending.enabled) {
-                glEnable(GL_BLEND);
-                glBlendEquation(blending.equation);
-                glBlendFunc(blending.sourceFactor, blending.destinationFactor);
-                glBlendColor(blending.constantColor.r, blending.constantColor.g, blending.constantColor.b, blending.constantColor.a);
-            } else {
-                glDisable(GL_BLEND);
+                GLStateCache::blendEquation(blending.equation);
+                GLStateCache::blendFunc(blending.sourceFactor, blending.destinationFactor);
+                GLStateCache::blendColor(blending.constantColor);
             }
 
             // Set the color and depth masks based on the provided options
-            glColorMask(colorMask.r, colorMask.g, colorMask.b, colorMask.a);
-            glDepthMask(depthMask);
+            GLStateCache::colorMask(colorMask);
+            GLStateCache::depthMask(depthMask);
         }
 
+        // Returns a small number that identifies the options of this pipeline state (used to sort draw calls by state)
+        // Equal states always give equal keys. Different states usually give different keys.
+        std::uint32_t getSortKey() const;
+
         // Given a json object, this function deserializes a PipelineState structure
         void deserialize(const nlohmann::json& data);
     };
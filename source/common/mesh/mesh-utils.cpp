@@ -5,14 +5,95 @@
 #include <tinyobj/tiny_obj_loader.h>
 
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <unordered_map>
+#include <cstring>
+#include <cstdio>
+
+// The header of a binary mesh cache file. It is followed by the vertices then the elements (as raw arrays)
+// The cache is only meant to be read on the machine that wrote it, so the data is stored in the native layout
+struct MeshCacheHeader {
+    char magic[4];              // Always "OMSH"
+    std::uint32_t version;      // Changed whenever the format changes
+    std::uint32_t vertexSize;   // sizeof(Vertex) when the file was written (detects changes to the vertex layout)
+    std::uint32_t vertexCount;
+    std::uint32_t elementCount;
+    std::uint32_t padding;
+    std::uint64_t sourceHash;   // The hash of the ".obj" file from which the cache was built
+    our::MeshBounds bounds;
+};
+
+static constexpr std::uint32_t MESH_CACHE_VERSION = 1;
+
+// Reads a mesh from the cache file if it exists and was built from a source with the given hash
+// Returns false if the cache is missing, stale or invalid
+static bool loadMeshCache(const std::string& cachePath, std::uint64_t sourceHash, our::mesh_utils::MeshData& data) {
+    auto file = std::make_unique<our::MappedFile>(cachePath);
+    if(!file->isOpen() || file->getSize() < sizeof(MeshCacheHeader)) return false;
+    MeshCacheHeader header;
+    std::memcpy(&header, file->getData(), sizeof(header));
+    if(std::memcmp(header.magic, "OMSH", 4) != 0 || header.version != MESH_CACHE_VERSION ||
+        header.vertexSize != sizeof(our::Vertex) || header.sourceHash != sourceHash) return false;
+    size_t expectedSize = sizeof(MeshCacheHeader) + header.vertexCount * sizeof(our::Vertex) + header.elementCount * sizeof(GLuint);
+    if(file->getSize() != expectedSize) return false;
+    // The arrays will be uploaded straight from the mapped memory (the header size keeps them aligned)
+    // so the data keeps the file mapped until the mesh is created
+    data.vertexData = reinterpret_cast<const our::Vertex*>(file->getData() + sizeof(MeshCacheHeader));
+    data.vertexCount = header.vertexCount;
+    data.elementData = reinterpret_cast<const GLuint*>(data.vertexData + header.vertexCount);
+    data.elementCount = header.elementCount;
+    data.bounds = header.bounds;
+    data.cache = std::move(file);
+    data.valid = true;
+    return true;
+}
 
-our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
+// Writes the mesh data to the cache file. Failing to write the cache is not an error (the mesh will be parsed again next time)
+static void writeMeshCache(const std::string& cachePath, std::uint64_t sourceHash, const std::vector<our::Vertex>& vertices,
+                           const std::vector<GLuint>& elements, const our::MeshBounds& bounds) {
+    MeshCacheHeader header = {};
+    std::memcpy(header.magic, "OMSH", 4);
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = sizeof(our::Vertex);
+    header.vertexCount = (std::uint32_t)vertices.size();
+    header.elementCount = (std::uint32_t)elements.size();
+    header.sourceHash = sourceHash;
+    header.bounds = bounds;
+    // We write to a temporary file then rename it, so a crash while writing never leaves a broken cache behind
+    std::string temporaryPath = cachePath + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if(!file) return;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(our::Vertex));
+        file.write(reinterpret_cast<const char*>(elements.data()), elements.size() * sizeof(GLuint));
+        if(!file) return;
+    }
+    std::remove(cachePath.c_str());
+    if(std::rename(temporaryPath.c_str(), cachePath.c_str()) != 0) std::remove(temporaryPath.c_str());
+}
+
+our::mesh_utils::MeshData our::mesh_utils::parseOBJ(const std::string& filename) {
+    OUR_PROFILE_SCOPE("Parse OBJ");
+
+    MeshData data;
+
+    // The parsed mesh is cached in a binary file next to the ".obj" file, so that the next loads skip the parsing
+    // The cache stores the hash of the ".obj" content so that it is rebuilt whenever the model changes
+    std::string cachePath = filename + ".meshcache";
+    std::uint64_t sourceHash = 0;
+    {
+        our::MappedFile source(filename);
+        if(source.isOpen()) {
+            sourceHash = our::hashBytes(source.getData(), source.getSize());
+            if(loadMeshCache(cachePath, sourceHash, data)) return data;
+        }
+    }
 
     // The data that we will use to initialize our mesh
-    std::vector<our::Vertex> vertices;
-    std::vector<GLuint> elements;
+    std::vector<our::Vertex>& vertices = data.vertices;
+    std::vector<GLuint>& elements = data.elements;
 
     // Since the OBJ can have duplicated vertices, we make them unique using this map
     // The key is the vertex, the value is its index in the vector "vertices".
@@ -27,7 +108,7 @@ our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
 
     if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.c_str())) {
         std::cerr << "Failed to load obj file \"" << filename << "\" due to error: " << err << std::endl;
-        return nullptr;
+        return data;
     }
     if (!warn.empty()) {
         std::cout << "WARN while loading obj file \"" << filename << "\": " << warn << std::endl;
@@ -81,7 +162,23 @@ our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
         }
     }
 
-    return new our::Mesh(vertices, elements);
+    data.bounds = our::MeshBounds::compute(vertices.data(), vertices.size());
+    writeMeshCache(cachePath, sourceHash, vertices, elements, data.bounds);
+    data.vertexData = vertices.data();
+    data.vertexCount = vertices.size();
+    data.elementData = elements.data();
+    data.elementCount = elements.size();
+    data.valid = true;
+    return data;
+}
+
+our::Mesh* our::mesh_utils::createMesh(const MeshData& data) {
+    if(!data.valid) return nullptr;
+    return new our::Mesh(data.vertexData, data.vertexCount, data.elementData, data.elementCount, data.bounds);
+}
+
+our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
+    return createMesh(parseOBJ(filename));
 }
 
 // Create a sphere (the vertex order in the triangles are CCW from the outside)
@@ -1,9 +1,32 @@
 #pragma once
 
 #include "mesh.hpp"
+#include "../mapped-file.hpp"
 #include <string>
+#include <vector>
+#include <memory>
 
 namespace our::mesh_utils {
+    // The vertices and elements of a model read from a file (before creating the OpenGL buffers)
+    // The arrays either live in the vectors (if the model was parsed) or in the mapped cache file
+    struct MeshData {
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> elements;
+        std::unique_ptr<MappedFile> cache;
+        const Vertex* vertexData = nullptr;
+        size_t vertexCount = 0;
+        const GLuint* elementData = nullptr;
+        size_t elementCount = 0;
+        MeshBounds bounds = {};
+        bool valid = false; // False if the file could not be loaded
+    };
+
+    // Reads an ".obj" file (or its binary cache) without calling OpenGL, so it can run on any thread
+    // If the file could not be loaded, the returned data is not valid
+    MeshData parseOBJ(const std::string& filename);
+    // Creates a mesh from the given data (it must be called on the thread that owns the OpenGL context)
+    // Returns nullptr if the data is not valid
+    Mesh* createMesh(const MeshData& data);
     // Load an ".obj" file into the mesh
     Mesh* loadOBJ(const std::string& filename);
     // Create a sphere (the vertex order in the triangles are CCW from the outside)
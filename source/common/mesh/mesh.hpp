@@ -1,7 +1,12 @@
 #pragma once
 
 #include <glad/gl.h>
+#include <glm/mat4x4.hpp>
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <vector>
 #include "vertex.hpp"
+#include "../profiler.hpp"
 
 namespace our {
 
@@ -9,6 +14,40 @@ namespace our {
     #define ATTRIB_LOC_COLOR    1
     #define ATTRIB_LOC_TEXCOORD 2
     #define ATTRIB_LOC_NORMAL   3
+    // The per-instance attributes used by instanced draws. A mat4 attribute takes 4 consecutive locations (one per column)
+    #define ATTRIB_LOC_INSTANCE_M    4
+    #define ATTRIB_LOC_INSTANCE_M_IT 8
+
+    // The data of a single instance in an instance buffer (see "Mesh::drawInstanced")
+    struct InstanceData {
+        glm::mat4 M;    // The model (local to world) matrix
+        glm::mat4 M_IT; // The inverse transpose of the model matrix (used to transform the normals)
+    };
+
+    // The bounds of the vertices of a mesh in its local space
+    struct MeshBounds {
+        glm::vec3 min = {0, 0, 0}, max = {0, 0, 0};
+        glm::vec3 sphereCenter = {0, 0, 0};
+        float sphereRadius = 0;
+
+        // Computes the bounding box then the bounding sphere around the box center
+        static MeshBounds compute(const Vertex* vertices, size_t count)
+        {
+            MeshBounds bounds;
+            if (count == 0)
+                return bounds;
+            bounds.min = bounds.max = vertices[0].position;
+            for (size_t index = 0; index < count; index++)
+            {
+                bounds.min = glm::min(bounds.min, vertices[index].position);
+                bounds.max = glm::max(bounds.max, vertices[index].position);
+            }
+            bounds.sphereCenter = (bounds.min + bounds.max) * 0.5f;
+            for (size_t index = 0; index < count; index++)
+                bounds.sphereRadius = std::max(bounds.sphereRadius, glm::distance(bounds.sphereCenter, vertices[index].position));
+            return bounds;
+        }
+    };
 
     class Mesh {
         // Here, we store the object names of the 3 main components of a mesh:
@@ -17,6 +56,13 @@ namespace our {
         unsigned int VAO;
         // We need to remember the number of elements that will be draw by glDrawElements 
         GLsizei elementCount;
+        // The per-instance attributes are only enabled in the vertex array the first time the mesh is drawn instanced
+        bool instanceAttributesEnabled = false;
+        // The bounds of the vertices in the local space of the mesh. They are computed (or given) once in the constructor
+        // (since the vertices are not kept on the RAM) and used by the renderer to skip the meshes that are outside the view
+        MeshBounds bounds;
+        // The number of bytes used by the vertex & element buffers on the VRAM
+        size_t memorySize;
     public:
 
         // The constructor takes two vectors:
@@ -27,6 +73,14 @@ namespace our {
         // an element buffer to store the element data on the VRAM,
         // a vertex array object to define how to read the vertex & element buffer during rendering 
         Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& elements)
+            : Mesh(vertices.data(), vertices.size(), elements.data(), elements.size(), MeshBounds::compute(vertices.data(), vertices.size()))
+        {
+        }
+
+        // Same as above but the data is given as raw arrays (e.g. straight from a mapped mesh cache file)
+        // with precomputed bounds
+        Mesh(const Vertex* vertices, size_t vertexCount, const unsigned int* elements, size_t elementCount, const MeshBounds& bounds)
+            : bounds(bounds), memorySize(vertexCount * sizeof(Vertex) + elementCount * sizeof(unsigned int))
         {
             // TODO: (Req 2) Write this function
             //  remember to store the number of elements in "elementCount" since you will need it for drawing
@@ -41,11 +95,11 @@ namespace our {
 
             // Bind VBO and set vertex data
             glBindBuffer(GL_ARRAY_BUFFER, VBO);                                                               // true
-            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW); // true
+            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices, GL_STATIC_DRAW); // true
 
             // Bind EBO and set element data
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements.size() * sizeof(unsigned int), elements.data(), GL_STATIC_DRAW);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, elementCount * sizeof(unsigned int), elements, GL_STATIC_DRAW);
 
             // Set vertex attribute pointers
             // Position attribute
@@ -65,19 +119,60 @@ namespace our {
             glBindVertexArray(0);
 
             // Remember the number of elements
-            elementCount = (GLsizei)elements.size();
+            this->elementCount = (GLsizei)elementCount;
         }
 
+        // Returns the local space bounding box and sphere of the mesh vertices
+        const MeshBounds &getBounds() const { return bounds; }
+
+        // Returns the number of bytes used by the buffers of this mesh on the VRAM
+        size_t getMemorySize() const { return memorySize; }
+
         // this function should render the mesh
         void draw() 
         {
             // TODO: (Req 2) Write this function
             //  Bind VAO and draw
             glBindVertexArray(VAO);
+            Profiler::count(ProfileCounter::DrawCalls);
             glDrawElements(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, (void *)0);
             glBindVertexArray(0);
         }
 
+        // Get the internal OpenGL name of the vertex array (it is small and unique among the living meshes, so it can be used to sort draws)
+        GLuint getVertexArray() const
+        {
+            return VAO;
+        }
+
+        // This function renders "count" instances of the mesh in a single draw call
+        // The instance data is read from the given buffer which must contain "count" consecutive InstanceData starting at "offset" (in bytes)
+        void drawInstanced(GLuint instanceBuffer, GLintptr offset, GLsizei count)
+        {
+            glBindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+            // Each matrix column is a vec4 attribute that advances once per instance (instead of once per vertex)
+            for (GLuint column = 0; column < 4; column++)
+            {
+                GLuint mLocation = ATTRIB_LOC_INSTANCE_M + column, mitLocation = ATTRIB_LOC_INSTANCE_M_IT + column;
+                glVertexAttribPointer(mLocation, 4, GL_FLOAT, false, sizeof(InstanceData),
+                    (void *)(offset + offsetof(InstanceData, M) + column * sizeof(glm::vec4)));
+                glVertexAttribPointer(mitLocation, 4, GL_FLOAT, false, sizeof(InstanceData),
+                    (void *)(offset + offsetof(InstanceData, M_IT) + column * sizeof(glm::vec4)));
+                if (!instanceAttributesEnabled)
+                {
+                    glEnableVertexAttribArray(mLocation);
+                    glVertexAttribDivisor(mLocation, 1);
+                    glEnableVertexAttribArray(mitLocation);
+                    glVertexAttribDivisor(mitLocation, 1);
+                }
+            }
+            instanceAttributesEnabled = true;
+            Profiler::count(ProfileCounter::DrawCalls);
+            glDrawElementsInstanced(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, (void *)0, count);
+            glBindVertexArray(0);
+        }
+
         // this function should delete the vertex & element buffers and the vertex array object
         ~Mesh(){
             //TODO: (Req 2) Write this function
@@ -0,0 +1,272 @@
+#include "profiler.hpp"
+#include "asset-cache.hpp"
+#include "texture/texture-uploader.hpp"
+
+#include <glad/gl.h>
+#include <imgui.h>
+#include <json/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace our {
+
+    namespace {
+        // A fixed size buffer that overwrites its oldest item when it is full
+        template<typename T>
+        struct RingBuffer {
+            std::vector<T> items;
+            size_t capacity, next = 0;
+
+            explicit RingBuffer(size_t capacity) : capacity(capacity) {}
+
+            void push(const T& item) {
+                if(items.size() < capacity) items.push_back(item);
+                else items[next] = item;
+                next = (next + 1) % capacity;
+            }
+
+            // Visits the items from the oldest to the newest
+            template<typename Visit>
+            void forEach(Visit&& visit) const {
+                size_t first = items.size() < capacity ? 0 : next;
+                for(size_t index = 0; index < items.size(); index++) visit(items[(first + index) % items.size()]);
+            }
+        };
+
+        struct FrameRecord {
+            std::uint64_t start, duration;
+            std::array<std::uint64_t, size_t(ProfileCounter::COUNT)> counters;
+        };
+
+        // The queries of the GPU scopes issued in one frame. The query objects are reused when the frame slot comes back
+        struct GpuFrame {
+            struct Query { const char* name; GLuint query; std::uint64_t start; };
+            std::vector<Query> queries;
+            size_t used = 0;
+        };
+
+        constexpr size_t CPU_EVENT_CAPACITY = size_t(1) << 16;
+        constexpr size_t GPU_EVENT_CAPACITY = size_t(1) << 14;
+        constexpr size_t FRAME_HISTORY = 256;
+        // The results of a frame's queries are read this number of frames later, when the GPU is (almost always) done with them
+        constexpr size_t GPU_FRAMES_IN_FLIGHT = 4;
+        // The thread id used for the GPU scopes in the Chrome trace
+        constexpr std::uint32_t GPU_TRACE_THREAD = 1000;
+
+        const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+        // The CPU events may come from the worker threads, so they are protected by a mutex
+        std::mutex cpuMutex;
+        RingBuffer<ProfileScopeRecord> cpuEvents(CPU_EVENT_CAPACITY);
+        std::vector<ProfileScopeRecord> currentFrameScopes, lastFrameScopes; // Only the main thread scopes
+
+        std::atomic<std::uint32_t> threadCount{0};
+        thread_local std::uint32_t threadIndex = threadCount++;
+        std::uint32_t mainThread = 0;
+
+        RingBuffer<ProfileScopeRecord> gpuEvents(GPU_EVENT_CAPACITY);
+        std::array<GpuFrame, GPU_FRAMES_IN_FLIGHT> gpuFrames;
+        std::vector<ProfileScopeRecord> lastGpuScopes; // The scopes of the last frame whose queries were read
+        int gpuScopeNesting = 0;
+
+        RingBuffer<FrameRecord> frames(FRAME_HISTORY);
+        std::uint64_t frameIndex = 0, frameStart = 0;
+
+        double toMilliseconds(std::uint64_t nanoseconds) { return double(nanoseconds) * 1e-6; }
+        double toMicroseconds(std::uint64_t nanoseconds) { return double(nanoseconds) * 1e-3; }
+
+        // Reads the queries of the given frame slot, then frees the slot for the current frame
+        void collectGpuFrame(GpuFrame& frame) {
+            if(frame.used == 0) return;
+            lastGpuScopes.clear();
+            for(size_t index = 0; index < frame.used; index++){
+                auto& query = frame.queries[index];
+                GLint available = GL_FALSE;
+                glGetQueryObjectiv(query.query, GL_QUERY_RESULT_AVAILABLE, &available);
+                // If the GPU is that far behind, we drop the result instead of stalling
+                if(!available) continue;
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(query.query, GL_QUERY_RESULT, &elapsed);
+                ProfileScopeRecord event{query.name, query.start, query.start + elapsed, 0, GPU_TRACE_THREAD};
+                gpuEvents.push(event);
+                lastGpuScopes.push_back(event);
+            }
+            frame.used = 0;
+        }
+    }
+
+    std::uint64_t Profiler::now() {
+        return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+    }
+
+    void Profiler::recordCpuScope(const char* name, std::uint64_t start, std::uint64_t end, std::uint32_t depth) {
+        ProfileScopeRecord event{name, start, end, depth, threadIndex};
+        std::lock_guard<std::mutex> lock(cpuMutex);
+        cpuEvents.push(event);
+        if(event.thread == mainThread) currentFrameScopes.push_back(event);
+    }
+
+    void Profiler::beginGpuScope(const char* name) {
+        if(gpuScopeNesting > 0){
+            gpuScopeNesting++;
+            return;
+        }
+        if(!isEnabled()) return;
+        GpuFrame& frame = gpuFrames[frameIndex % GPU_FRAMES_IN_FLIGHT];
+        if(frame.used == frame.queries.size()){
+            GLuint query;
+            glGenQueries(1, &query);
+            frame.queries.push_back({nullptr, query, 0});
+        }
+        auto& query = frame.queries[frame.used++];
+        query.name = name;
+        query.start = now();
+        glBeginQuery(GL_TIME_ELAPSED, query.query);
+        gpuScopeNesting = 1;
+    }
+
+    void Profiler::endGpuScope() {
+        if(gpuScopeNesting == 0) return;
+        if(--gpuScopeNesting == 0) glEndQuery(GL_TIME_ELAPSED);
+    }
+
+    const char* Profiler::getCounterName(ProfileCounter counter) {
+        switch(counter){
+            case ProfileCounter::DrawCalls: return "Draw calls";
+            case ProfileCounter::StateChanges: return "State changes";
+            case ProfileCounter::UniformSets: return "Uniform sets";
+            case ProfileCounter::VisibleObjects: return "Visible objects";
+            case ProfileCounter::CulledObjects: return "Culled objects";
+            default: return "Unknown";
+        }
+    }
+
+    const std::vector<ProfileScopeRecord>& Profiler::getLastFrameScopes() {
+        return lastFrameScopes;
+    }
+
+    const std::vector<ProfileScopeRecord>& Profiler::getLastGpuScopes() {
+        return lastGpuScopes;
+    }
+
+    void Profiler::newFrame() {
+        std::uint64_t time = now();
+        if(isEnabled() && frameStart != 0)
+            frames.push(FrameRecord{frameStart, time - frameStart, counters});
+        lastCounters = counters;
+        counters.fill(0);
+        {
+            std::lock_guard<std::mutex> lock(cpuMutex);
+            lastFrameScopes.swap(currentFrameScopes);
+            currentFrameScopes.clear();
+            mainThread = threadIndex;
+        }
+        frameIndex++;
+        frameStart = isEnabled() ? time : 0;
+        collectGpuFrame(gpuFrames[frameIndex % GPU_FRAMES_IN_FLIGHT]);
+    }
+
+    void Profiler::drawOverlay() {
+        if(!overlayVisible) return;
+        ImGui::SetNextWindowSize(ImVec2(420, 0), ImGuiCond_FirstUseEver);
+        if(ImGui::Begin("Profiler", &overlayVisible)){
+            bool profiling = isEnabled();
+            if(ImGui::Checkbox("Enabled", &profiling)) setEnabled(profiling);
+
+            std::vector<float> frameTimes;
+            frames.forEach([&](const FrameRecord& frame){ frameTimes.push_back((float)toMilliseconds(frame.duration)); });
+            if(!frameTimes.empty()){
+                float maximum = *std::max_element(frameTimes.begin(), frameTimes.end());
+                float average = 0;
+                for(float frameTime : frameTimes) average += frameTime;
+                average /= frameTimes.size();
+                ImGui::Text("Frame: %.2f ms (average %.2f ms, max %.2f ms)", frameTimes.back(), average, maximum);
+                ImGui::PlotLines("##frame-times", frameTimes.data(), (int)frameTimes.size(), 0, nullptr, 0.0f, maximum * 1.2f, ImVec2(-1, 60));
+            }
+
+            if(ImGui::CollapsingHeader("CPU", ImGuiTreeNodeFlags_DefaultOpen)){
+                // The scopes are recorded when they end, so we sort them by their start to show the parents before their children
+                std::vector<ProfileScopeRecord> scopes = lastFrameScopes;
+                std::sort(scopes.begin(), scopes.end(), [](const ProfileScopeRecord& first, const ProfileScopeRecord& second){ return first.start < second.start; });
+                for(auto& scope : scopes)
+                    ImGui::Text("%*s%s: %.3f ms", int(scope.depth * 2), "", scope.name, toMilliseconds(scope.end - scope.start));
+            }
+            if(ImGui::CollapsingHeader("GPU", ImGuiTreeNodeFlags_DefaultOpen)){
+                for(auto& scope : lastGpuScopes)
+                    ImGui::Text("%s: %.3f ms", scope.name, toMilliseconds(scope.end - scope.start));
+            }
+            if(ImGui::CollapsingHeader("Counters", ImGuiTreeNodeFlags_DefaultOpen)){
+                for(size_t index = 0; index < size_t(ProfileCounter::COUNT); index++)
+                    ImGui::Text("%s: %llu", getCounterName(ProfileCounter(index)), (unsigned long long)lastCounters[index]);
+            }
+            if(ImGui::CollapsingHeader("Assets", ImGuiTreeNodeFlags_DefaultOpen)){
+                ImGui::Text("Asset cache: %zu assets, %.1f / %.1f MB", AssetCache::getAssetCount(),
+                    AssetCache::getMemorySize() / 1048576.0, AssetCache::getBudget() / 1048576.0);
+                ImGui::Text("Pending texture uploads: %zu", TextureUploader::getPendingCount());
+            }
+
+            static std::string exportMessage;
+            if(ImGui::Button("Export Chrome trace")){
+                std::string path = "profiles/trace-" + std::to_string(frameIndex) + ".json";
+                exportMessage = exportChromeTrace(path) ? "Saved to " + path : "Failed to save " + path;
+            }
+            if(!exportMessage.empty()) ImGui::TextUnformatted(exportMessage.c_str());
+        }
+        ImGui::End();
+    }
+
+    bool Profiler::exportChromeTrace(const std::string& path) {
+        nlohmann::json events = nlohmann::json::array();
+        auto addThreadName = [&](std::uint32_t thread, const std::string& name){
+            events.push_back({{"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", thread}, {"args", {{"name", name}}}});
+        };
+        {
+            std::lock_guard<std::mutex> lock(cpuMutex);
+            std::uint32_t threads = threadCount.load();
+            for(std::uint32_t thread = 0; thread < threads; thread++)
+                addThreadName(thread, thread == mainThread ? "Main" : "Worker " + std::to_string(thread));
+            cpuEvents.forEach([&](const ProfileScopeRecord& event){
+                events.push_back({{"name", event.name}, {"cat", "cpu"}, {"ph", "X"}, {"pid", 1}, {"tid", event.thread},
+                    {"ts", toMicroseconds(event.start)}, {"dur", toMicroseconds(event.end - event.start)}});
+            });
+        }
+        addThreadName(GPU_TRACE_THREAD, "GPU");
+        gpuEvents.forEach([&](const ProfileScopeRecord& event){
+            events.push_back({{"name", event.name}, {"cat", "gpu"}, {"ph", "X"}, {"pid", 1}, {"tid", GPU_TRACE_THREAD},
+                {"ts", toMicroseconds(event.start)}, {"dur", toMicroseconds(event.end - event.start)}});
+        });
+        frames.forEach([&](const FrameRecord& frame){
+            nlohmann::json values = {{"Frame time (ms)", toMilliseconds(frame.duration)}};
+            for(size_t index = 0; index < size_t(ProfileCounter::COUNT); index++)
+                values[getCounterName(ProfileCounter(index))] = frame.counters[index];
+            events.push_back({{"name", "Frame"}, {"ph", "C"}, {"pid", 1}, {"ts", toMicroseconds(frame.start)}, {"args", values}});
+        });
+
+        // Make sure the directory in which we want to save the trace exists
+        std::filesystem::path filePath(path);
+        if(filePath.has_parent_path()){
+            std::error_code ec;
+            std::filesystem::create_directories(filePath.parent_path(), ec);
+            if(ec) return false;
+        }
+        std::ofstream file(path);
+        if(!file) return false;
+        file << nlohmann::json{{"traceEvents", events}, {"displayTimeUnit", "ms"}}.dump();
+        return (bool)file;
+    }
+
+    void Profiler::destroy() {
+        for(auto& frame : gpuFrames){
+            for(auto& query : frame.queries) glDeleteQueries(1, &query.query);
+            frame.queries.clear();
+            frame.used = 0;
+        }
+        gpuScopeNesting = 0;
+    }
+
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Used to give each profiling scope a unique variable name
+#define OUR_PROFILE_CONCAT_INNER(a, b) a##b
+#define OUR_PROFILE_CONCAT(a, b) OUR_PROFILE_CONCAT_INNER(a, b)
+// Measures the CPU time from this line to the end of the enclosing block (the name must be a string literal)
+#define OUR_PROFILE_SCOPE(name) our::ProfileScope OUR_PROFILE_CONCAT(profileScope, __LINE__)(name)
+// Measures the GPU time of the OpenGL commands issued from this line to the end of the enclosing block
+#define OUR_PROFILE_GPU_SCOPE(name) our::GpuProfileScope OUR_PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
+
+namespace our {
+
+    // The values counted by the profiler every frame
+    enum class ProfileCounter {
+        DrawCalls,      // Every glDraw* call
+        StateChanges,   // Every state change that reached OpenGL (see "GLStateCache")
+        UniformSets,    // Every glUniform* call
+        VisibleObjects, // The mesh renderers that passed the frustum culling
+        CulledObjects,  // The mesh renderers that were skipped by the frustum culling
+        COUNT
+    };
+
+    // A finished CPU or GPU scope (times are in nanoseconds since the start of the application)
+    // For the GPU scopes, "start" is the CPU time at which their commands started being issued (the GPU runs them a bit later)
+    struct ProfileScopeRecord {
+        const char* name;
+        std::uint64_t start, end;
+        std::uint32_t depth, thread;
+    };
+
+    // This static class collects the timings of the frames to find what causes the slow frames (and stutter)
+    // - CPU scopes (see "ProfileScope") are stored in a ring buffer, so the last few seconds can always be exported.
+    // - GPU scopes (see "GpuProfileScope") are measured by GL_TIME_ELAPSED queries that are read a few frames later to avoid stalling.
+    // - Counters are summed every frame (they are cheap enough to always be counted, even when the profiler is disabled).
+    // The timings can be inspected in an ImGui overlay or exported as a Chrome trace (open it in chrome://tracing or https://ui.perfetto.dev).
+    // WARNING: Only the CPU scopes may be used from the worker threads. Everything else must be called on the main thread.
+    class Profiler {
+        static inline std::atomic<bool> enabled{false};
+        static inline bool overlayVisible = false;
+        static inline std::array<std::uint64_t, size_t(ProfileCounter::COUNT)> counters{};
+        static inline std::array<std::uint64_t, size_t(ProfileCounter::COUNT)> lastCounters{};
+
+    public:
+        // When the profiler is disabled, the scopes record nothing (but the counters are still counted)
+        static void setEnabled(bool value) { enabled.store(value, std::memory_order_relaxed); }
+        static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+        static void setOverlayVisible(bool visible) { overlayVisible = visible; }
+        static bool isOverlayVisible() { return overlayVisible; }
+
+        // Returns the time in nanoseconds since the start of the application
+        static std::uint64_t now();
+
+        // Records a finished CPU scope. It is called by "ProfileScope" (and is safe to call from any thread)
+        static void recordCpuScope(const char* name, std::uint64_t start, std::uint64_t end, std::uint32_t depth);
+        // Starts and ends a GPU scope. The GPU scopes can't be nested (a nested scope is ignored)
+        static void beginGpuScope(const char* name);
+        static void endGpuScope();
+
+        static void count(ProfileCounter counter, std::uint64_t amount = 1) { counters[size_t(counter)] += amount; }
+        // Returns the value of the counter in the last finished frame
+        static std::uint64_t getCounter(ProfileCounter counter) { return lastCounters[size_t(counter)]; }
+        static const char* getCounterName(ProfileCounter counter);
+
+        // Returns the CPU scopes of the main thread in the last finished frame (in the order they ended)
+        static const std::vector<ProfileScopeRecord>& getLastFrameScopes();
+        // Returns the GPU scopes of the last frame whose queries were read (it is a few frames behind)
+        static const std::vector<ProfileScopeRecord>& getLastGpuScopes();
+
+        // Finishes the current frame and starts the next one. It must be called once at the start of every frame
+        // It also collects the results of the GPU queries that are ready
+        static void newFrame();
+
+        // Draws the profiler window (it must be called between ImGui::NewFrame and ImGui::Render)
+        static void drawOverlay();
+
+        // Writes the recorded scopes and counters as a Chrome trace (JSON). Returns false if the file could not be written
+        static bool exportChromeTrace(const std::string& path);
+
+        // Deletes the GPU queries. This should be called at exit while the OpenGL context still exists
+        static void destroy();
+    };
+
+    // Measures the CPU time between its construction and destruction (use it through "OUR_PROFILE_SCOPE")
+    class ProfileScope {
+        static inline thread_local std::uint32_t depth = 0;
+        const char* name;
+        std::uint64_t start = 0;
+        bool active;
+    public:
+        explicit ProfileScope(const char* name) : name(name), active(Profiler::isEnabled()) {
+            if(active){
+                depth++;
+                start = Profiler::now();
+            }
+        }
+        ~ProfileScope() {
+            if(active){
+                depth--;
+                Profiler::recordCpuScope(name, start, Profiler::now(), depth);
+            }
+        }
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
+    };
+
+    // Measures the GPU time of the commands issued between its construction and destruction (use it through "OUR_PROFILE_GPU_SCOPE")
+    // It also measures the CPU time spent issuing the commands
+    class GpuProfileScope {
+        ProfileScope cpuScope;
+    public:
+        explicit GpuProfileScope(const char* name) : cpuScope(name) { Profiler::beginGpuScope(name); }
+        ~GpuProfileScope() { Profiler::endGpuScope(); }
+        GpuProfileScope(const GpuProfileScope&) = delete;
+        GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+    };
+
+}
@@ -0,0 +1,102 @@
+#include "program-binary-cache.hpp"
+#include "../mapped-file.hpp"
+#include "../profiler.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+
+namespace our {
+
+    // The header of a program binary cache file. It is followed by the binary itself
+    struct ProgramBinaryHeader {
+        char magic[4];            // Always "OPRG"
+        std::uint32_t version;    // Changed whenever the format changes
+        std::uint64_t key;        // The key of the program (guards against a renamed or truncated file)
+        std::uint32_t format;     // The binary format returned by glGetProgramBinary
+        std::uint32_t size;       // The size of the binary in bytes
+    };
+
+    static constexpr std::uint32_t PROGRAM_BINARY_VERSION = 1;
+
+    bool ProgramBinaryCache::isEnabled() {
+        if(!enabled) return false;
+        if(supported < 0){
+            // The binaries are core in OpenGL 4.1 and an extension before that. A driver may also support no format at all
+            GLint formats = 0;
+            if(GLAD_GL_VERSION_4_1 || GLAD_GL_ARB_get_program_binary)
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            supported = formats > 0 ? 1 : 0;
+        }
+        return supported == 1;
+    }
+
+    std::string ProgramBinaryCache::getPath(std::uint64_t key) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.progbin", (unsigned long long)key);
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    std::uint64_t ProgramBinaryCache::getKey(const std::vector<ShaderSource>& sources) {
+        std::uint64_t hash = hashBytes(&PROGRAM_BINARY_VERSION, sizeof(PROGRAM_BINARY_VERSION));
+        for(GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}){
+            const char* value = reinterpret_cast<const char*>(glGetString(name));
+            if(value) hash = hashBytes(value, std::strlen(value) + 1, hash);
+        }
+        for(const ShaderSource& source : sources){
+            hash = hashBytes(&source.type, sizeof(source.type), hash);
+            hash = hashBytes(source.code.data(), source.code.size() + 1, hash);
+        }
+        return hash;
+    }
+
+    bool ProgramBinaryCache::load(GLuint program, std::uint64_t key) {
+        OUR_PROFILE_SCOPE("Load program binary");
+        auto file = std::make_unique<MappedFile>(getPath(key));
+        if(!file->isOpen() || file->getSize() < sizeof(ProgramBinaryHeader)) return false;
+        ProgramBinaryHeader header;
+        std::memcpy(&header, file->getData(), sizeof(header));
+        if(std::memcmp(header.magic, "OPRG", 4) != 0 || header.version != PROGRAM_BINARY_VERSION || header.key != key ||
+            file->getSize() != sizeof(ProgramBinaryHeader) + header.size) return false;
+        glProgramBinary(program, header.format, file->getData() + sizeof(ProgramBinaryHeader), (GLsizei)header.size);
+        // The driver rejects the binaries it can't use anymore by failing the link
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        return status == GL_TRUE;
+    }
+
+    void ProgramBinaryCache::store(GLuint program, std::uint64_t key) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0) return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+        if(length <= 0) return;
+
+        ProgramBinaryHeader header = {};
+        std::memcpy(header.magic, "OPRG", 4);
+        header.version = PROGRAM_BINARY_VERSION;
+        header.key = key;
+        header.format = format;
+        header.size = (std::uint32_t)length;
+
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        if(ec) return;
+        // We write to a temporary file then rename it, so a crash while writing never leaves a broken cache behind
+        std::string path = getPath(key), temporaryPath = path + ".tmp";
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+            if(!file) return;
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(binary.data(), length);
+            if(!file) return;
+        }
+        std::remove(path.c_str());
+        if(std::rename(temporaryPath.c_str(), path.c_str()) != 0) std::remove(temporaryPath.c_str());
+    }
+
+}
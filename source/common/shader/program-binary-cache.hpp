@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace our {
+
+    // A shader stage source waiting to be compiled (see "ShaderProgram::attach")
+    struct ShaderSource {
+        GLenum type;
+        std::string path; // Only used in the error messages
+        std::string code;
+    };
+
+    // This static class stores the linked shader programs on disk (using glGetProgramBinary) so that the next runs
+    // load them with glProgramBinary instead of compiling the GLSL again (which is slow, especially on Mesa)
+    // Each binary is stored in its own file named after the key of the program, which is a hash of the stage sources
+    // and of the driver (vendor, renderer & version), so editing a shader or updating the driver just misses the cache.
+    // The driver may still reject a binary (e.g. after a driver update that kept the same version string),
+    // in which case the program is compiled from the sources and the binary is replaced.
+    // It is enabled by the "shaderCache" object of the application config:
+    //    "shaderCache": { "enabled": true, "directory": "cache/shaders" }
+    class ProgramBinaryCache {
+        static inline bool enabled = false;
+        static inline std::string directory = "cache/shaders";
+        // -1: not checked yet (it needs an OpenGL context), 0: not supported by the driver, 1: supported
+        static inline int supported = -1;
+
+        static std::string getPath(std::uint64_t key);
+
+    public:
+        static void setEnabled(bool value) { enabled = value; }
+        static void setDirectory(const std::string& path) { directory = path; }
+        // Returns true if the cache is enabled and the driver can save program binaries
+        static bool isEnabled();
+
+        // Returns the key of a program made of the given stages
+        static std::uint64_t getKey(const std::vector<ShaderSource>& sources);
+        // Loads the binary with the given key into the program. Returns true if the program is now linked
+        static bool load(GLuint program, std::uint64_t key);
+        // Writes the binary of a linked program (that was linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT)
+        // Failing to write the cache is not an error (the program will be compiled again next time)
+        static void store(GLuint program, std::uint64_t key);
+    };
+
+}
@@ -0,0 +1,112 @@
+#include "shader-utils.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_set>
+
+namespace our::shader_utils {
+
+    // The data shared by all the files expanded into one source
+    struct PreprocessState {
+        std::vector<std::string> files;
+        std::unordered_set<std::string> included;
+        std::vector<std::string>* keywords;
+        int version = 330; // From the "#version" of the shader (it changes the meaning of "#line")
+    };
+
+    // Returns true if the line (after its leading spaces) starts with the given directive
+    static bool startsWith(const std::string& line, const std::string& directive) {
+        size_t start = line.find_first_not_of(" \t");
+        return start != std::string::npos && line.compare(start, directive.size(), directive) == 0;
+    }
+
+    // Returns a "#line" directive after which the compiler counts from the given line of the given source string
+    // Up to GLSL 4.10, "#line N" means that the next line is N + 1. Since 4.20, it means that the next line is N.
+    static std::string lineDirective(const PreprocessState& state, int nextLine, const std::string& fileIndex) {
+        return "#line " + std::to_string(state.version >= 420 ? nextLine : nextLine - 1) + " " + fileIndex + "\n";
+    }
+
+    static bool expand(const std::filesystem::path& path, const std::vector<std::string>& defines, PreprocessState& state, std::string& source) {
+        std::ifstream file(path);
+        if(!file){
+            std::cerr << "ERROR: Couldn't open shader file: " << path.generic_string() << std::endl;
+            return false;
+        }
+        std::string fileIndex = std::to_string(state.files.size());
+        bool root = state.files.empty();
+        state.files.push_back(path.generic_string());
+        // The included files start their own numbering under their own source string number
+        if(!root) source += lineDirective(state, 1, fileIndex);
+
+        std::string line;
+        int lineNumber = 0;
+        while(std::getline(file, line)){
+            lineNumber++;
+            if(startsWith(line, "#include")){
+                size_t open = line.find('"'), close = open == std::string::npos ? open : line.find('"', open + 1);
+                if(close == std::string::npos){
+                    std::cerr << "ERROR: Invalid #include in " << path.generic_string() << ":" << lineNumber << std::endl;
+                    return false;
+                }
+                std::filesystem::path includePath = (path.parent_path() / line.substr(open + 1, close - open - 1)).lexically_normal();
+                if(state.included.insert(includePath.generic_string()).second && !expand(includePath, {}, state, source))
+                    return false;
+                // Go back to this file's line numbers
+                source += lineDirective(state, lineNumber + 1, fileIndex);
+                continue;
+            }
+            if(startsWith(line, "#pragma keywords")){
+                if(state.keywords){
+                    std::istringstream words(line.substr(line.find("keywords") + 8));
+                    std::string keyword;
+                    while(words >> keyword)
+                        if(std::find(state.keywords->begin(), state.keywords->end(), keyword) == state.keywords->end())
+                            state.keywords->push_back(keyword);
+                }
+                // An empty line keeps the line numbers unchanged
+                source += '\n';
+                continue;
+            }
+            source += line;
+            source += '\n';
+            // The defines must come after "#version" (which must be the first directive)
+            if(root && startsWith(line, "#version")){
+                std::istringstream words(line.substr(line.find("version") + 7));
+                words >> state.version;
+                for(const std::string& define : defines) source += "#define " + define + "\n";
+                if(!defines.empty()) source += lineDirective(state, lineNumber + 1, fileIndex);
+            }
+        }
+        return true;
+    }
+
+    bool preprocess(const std::string& path, const std::vector<std::string>& defines, std::string& source,
+                    std::vector<std::string>* keywords, std::vector<std::string>* files) {
+        PreprocessState state;
+        state.keywords = keywords;
+        state.included.insert(std::filesystem::path(path).lexically_normal().generic_string());
+        source.clear();
+        bool success = expand(path, defines, state, source);
+        if(files) *files = std::move(state.files);
+        return success;
+    }
+
+    std::vector<std::string> parseDefines(const nlohmann::json& data) {
+        std::vector<std::string> defines;
+        if(!data.is_object()) return defines;
+        for(auto& [name, value] : data.items()){
+            if(value.is_boolean()){
+                if(value.get<bool>()) defines.push_back(name);
+            } else if(value.is_string()){
+                defines.push_back(name + " " + value.get<std::string>());
+            } else {
+                defines.push_back(name + " " + value.dump());
+            }
+        }
+        return defines;
+    }
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <json/json.hpp>
+
+#include <string>
+#include <vector>
+
+namespace our::shader_utils {
+
+    // Reads a shader file and expands it into a single GLSL source:
+    // - Every line in the form '#include "relative/path.glsl"' is replaced by the content of that file (relative to the including file).
+    //   A file is only included once per shader, so the included files don't need include guards.
+    // - The given defines (each in the form "NAME" or "NAME VALUE") are inserted right after the "#version" line.
+    // - The lines in the form "#pragma keywords NAME1 NAME2 ..." declare the keywords of the shader (see "ShaderVariants").
+    //   They are removed from the source and their names are appended to "keywords" (if given) without duplicates.
+    // "#line" directives are inserted so that the compilation errors point to the right line. Each file gets a source string number
+    // (its index in "files" if given, the file itself is 0).
+    // Returns false (and prints the error) if a file couldn't be read
+    bool preprocess(const std::string& path, const std::vector<std::string>& defines, std::string& source,
+                    std::vector<std::string>* keywords = nullptr, std::vector<std::string>* files = nullptr);
+
+    // Converts a json object in the form { "NAME": value, ... } to a list of defines in the form "NAME value"
+    // A value of true gives just "NAME" and a value of false skips the define
+    std::vector<std::string> parseDefines(const nlohmann::json& data);
+
+}
@@ -0,0 +1,55 @@
+#include "shader-variants.hpp"
+#include "shader-utils.hpp"
+#include "../asset-cache.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace our
+{
+
+    ShaderVariants::ShaderVariants(const std::string &vertexShaderPath, const std::string &fragmentShaderPath, const std::vector<std::string> &defines)
+        : vertexShaderPath(vertexShaderPath), fragmentShaderPath(fragmentShaderPath), defines(defines)
+    {
+        // Both stages can declare keywords, a keyword declared by both is the same bit
+        std::string source;
+        shader_utils::preprocess(vertexShaderPath, {}, source, &keywords);
+        shader_utils::preprocess(fragmentShaderPath, {}, source, &keywords);
+        if (keywords.size() > MAX_KEYWORDS)
+        {
+            std::cerr << "The shaders \"" << vertexShaderPath << "\" and \"" << fragmentShaderPath << "\" declare more than "
+                      << MAX_KEYWORDS << " keywords, the extra keywords are ignored" << std::endl;
+            keywords.resize(MAX_KEYWORDS);
+        }
+    }
+
+    ShaderVariants::~ShaderVariants()
+    {
+        for (auto &[mask, shader] : variants)
+            AssetCache::release(shader);
+    }
+
+    std::uint32_t ShaderVariants::getKeyword(const std::string &name) const
+    {
+        auto it = std::find(keywords.begin(), keywords.end(), name);
+        return it == keywords.end() ? 0u : 1u << std::uint32_t(it - keywords.begin());
+    }
+
+    ShaderProgram *ShaderVariants::get(std::uint32_t keywordMask)
+    {
+        // The bits of the undeclared keywords are dropped so that they don't compile the same variant twice
+        if (keywords.size() < MAX_KEYWORDS)
+            keywordMask &= (1u << keywords.size()) - 1u;
+        if (auto it = variants.find(keywordMask); it != variants.end())
+            return it->second;
+        // The keywords are defined in the order they are declared, so a mask always gives the same source (and cache keys)
+        std::vector<std::string> variantDefines = defines;
+        for (size_t index = 0; index < keywords.size(); index++)
+            if (keywordMask & (1u << index))
+                variantDefines.push_back(keywords[index]);
+        ShaderProgram *shader = acquireShader(vertexShaderPath, fragmentShaderPath, variantDefines);
+        variants[keywordMask] = shader;
+        return shader;
+    }
+
+}
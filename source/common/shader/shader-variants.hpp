@@ -0,0 +1,45 @@
+#pragma once
+
+#include "shader.hpp"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+namespace our
+{
+
+    // A family of shader programs built from the same files with different keywords defined
+    // The keywords are declared in the shader files (or their includes) with "#pragma keywords NAME1 NAME2 ..."
+    // and the code uses "#ifdef NAME" to specialize itself, so each variant only contains the code it needs (no runtime branches).
+    // A set of keywords is a bitmask (bit i is the i-th declared keyword). A variant is only compiled the first time it is requested,
+    // then it is kept here (and shared with the other families through the "AssetCache").
+    // Besides the keywords, every variant gets the defines of the family (e.g. "STEPS 16").
+    class ShaderVariants
+    {
+        std::string vertexShaderPath, fragmentShaderPath;
+        std::vector<std::string> defines;
+        std::vector<std::string> keywords;
+        std::unordered_map<std::uint32_t, ShaderProgram *> variants;
+
+    public:
+        static constexpr size_t MAX_KEYWORDS = 32;
+
+        // Reads the keywords declared by the shader files (nothing is compiled until a variant is requested)
+        ShaderVariants(const std::string &vertexShaderPath, const std::string &fragmentShaderPath, const std::vector<std::string> &defines = {});
+        // Gives the variants back to the asset cache
+        ~ShaderVariants();
+
+        // Returns the bit of the given keyword or 0 if the shader doesn't declare it (so it can be or-ed without checking)
+        std::uint32_t getKeyword(const std::string &name) const;
+        const std::vector<std::string> &getKeywords() const { return keywords; }
+
+        // Returns the variant with the given keywords (compiling it if it is the first time it is requested)
+        ShaderProgram *get(std::uint32_t keywordMask = 0);
+
+        ShaderVariants(const ShaderVariants &) = delete;
+        ShaderVariants &operator=(const ShaderVariants &) = delete;
+    };
+
+}
@@ -1,67 +1,145 @@
 #include "shader.hpp"
+#include "shader-utils.hpp"
 
 #include <cassert>
 #include <iostream>
-#include <fstream>
 #include <string>
 
 // Forward definition for error checking functions
 std::string checkForShaderCompilationErrors(GLuint shader);
 std::string checkForLinkingErrors(GLuint program);
 
-bool our::ShaderProgram::attach(const std::string &filename, GLenum type) const
+bool our::ShaderProgram::attach(const std::string &filename, GLenum type, const std::vector<std::string> &defines)
 {
-    // Here, we open the file and read a string from it containing the GLSL code of our shader
-    std::ifstream file(filename);
-    if (!file)
-    {
-        std::cerr << "ERROR: Couldn't open shader file: " << filename << std::endl;
+    // Here, we read the GLSL code of our shader with its included files and defines
+    std::string sourceString;
+    std::vector<std::string> files;
+    if (!shader_utils::preprocess(filename, defines, sourceString, nullptr, &files))
         return false;
+
+    // The errors of the included files are reported with their source string number, so we list the numbers in the stage name
+    std::string name = filename;
+    for (size_t index = 1; index < files.size(); index++)
+        name += (index == 1 ? " (" : ", ") + std::to_string(index) + ": " + files[index] + (index + 1 == files.size() ? ")" : "");
+
+    // The compilation is deferred to "link", since it is skipped entirely when the program binary is cached
+    sources.push_back({type, name, std::move(sourceString)});
+    return true;
+}
+
+bool our::ShaderProgram::link()
+{
+    OUR_PROFILE_SCOPE("Link shader");
+    // The attached sources are only needed for this link
+    std::vector<ShaderSource> stages = std::move(sources);
+    sources.clear();
+
+    // If the same sources were linked by this driver before, the driver loads the program without compiling anything
+    bool useCache = ProgramBinaryCache::isEnabled();
+    std::uint64_t key = 0;
+    if (useCache)
+    {
+        key = ProgramBinaryCache::getKey(stages);
+        if (ProgramBinaryCache::load(this->program, key))
+        {
+            cacheUniformLocations();
+            return true;
+        }
     }
-    std::string sourceString = std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
-    const char *sourceCStr = sourceString.c_str();
-    file.close();
 
     // TODO: Complete this function
     // Note: The function "checkForShaderCompilationErrors" checks if there is
     //  an error in the given shader. You should use it to check if there is a
     //  compilation error and print it so that you can know what is wrong with
     //  the shader. The returned string will be empty if there is no errors.
+    std::vector<GLuint> shaders;
+    bool compiled = true;
+    for (const ShaderSource &stage : stages)
+    {
+        const char *sourceCStr = stage.code.c_str();
+        GLuint shader = glCreateShader(stage.type);
+        glShaderSource(shader, 1, &sourceCStr, nullptr); // 1 --> only one string holding the source code of the shader -- nullptr --> the source code is null-terminated
+        glCompileShader(shader);
 
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &sourceCStr, nullptr); // 1 --> only one string holding the source code of the shader -- nullptr --> the source code is null-terminated
-    glCompileShader(shader);
+        std::string error = checkForShaderCompilationErrors(shader);
+        if (!error.empty())
+        {
+            std::cout << "ERROR in " << stage.path << ":" << std::endl << error << std::endl;
+            glDeleteShader(shader);
+            compiled = false;
+            continue;
+        }
+        glAttachShader(this->program, shader);
+        shaders.push_back(shader);
+    }
 
-    std::string error = checkForShaderCompilationErrors(shader);
-    if (!error.empty())
+    // Note: The function "checkForLinkingErrors" checks if there is
+    //  an error in the given program. You should use it to check if there is a
+    //  linking error and print it so that you can know what is wrong with the
+    //  program. The returned string will be empty if there is no errors.
+    bool linked = false;
+    if (compiled)
     {
-        std::cout << error << std::endl;
-        return false;
+        // The driver may only keep the binary of the programs that asked for it before linking
+        if (useCache)
+            glProgramParameteri(this->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(this->program);
+        std::string error = checkForLinkingErrors(this->program);
+        if (!error.empty())
+            std::cout << error << std::endl;
+        else
+            linked = true;
     }
+    // The linked program doesn't need the shader objects anymore
+    for (GLuint shader : shaders)
+    {
+        glDetachShader(this->program, shader);
+        glDeleteShader(shader);
+    }
+    if (!linked)
+        return false;
 
-    glAttachShader(this->program, shader);
-    glDeleteShader(shader);
-
-    // We return true if the compilation succeeded
+    if (useCache)
+        ProgramBinaryCache::store(this->program, key);
+    cacheUniformLocations();
     return true;
 }
 
-bool our::ShaderProgram::link() const
+void our::ShaderProgram::cacheUniformLocations()
 {
-    // TODO: Complete this function
-    // Note: The function "checkForLinkingErrors" checks if there is
-    //  an error in the given program. You should use it to check if there is a
-    //  linking error and print it so that you can know what is wrong with the
-    //  program. The returned string will be empty if there is no errors.
-    glLinkProgram(this->program);
-    std::string error = checkForLinkingErrors(this->program);
+    uniformLocations.clear();
 
-    if (!error.empty())
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(this->program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(this->program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::string name(maxLength, '\0');
+
+    for (GLint index = 0; index < count; index++)
     {
-        std::cout << error << std::endl;
-        return false;
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type;
+        glGetActiveUniform(this->program, (GLuint)index, maxLength, &length, &size, &type, name.data());
+        std::string uniformName = name.substr(0, length);
+
+        // Uniforms inside uniform blocks have no location so we skip them
+        GLint location = glGetUniformLocation(this->program, uniformName.c_str());
+        if (location < 0)
+            continue;
+        uniformLocations[uniformName] = location;
+
+        // Arrays of basic types are reported once as "name[0]" so we add the base name and every element
+        if (size > 1 && uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+        {
+            std::string baseName = uniformName.substr(0, uniformName.size() - 3);
+            uniformLocations[baseName] = location;
+            for (GLint element = 1; element < size; element++)
+            {
+                std::string elementName = baseName + "[" + std::to_string(element) + "]";
+                uniformLocations[elementName] = glGetUniformLocation(this->program, elementName.c_str());
+            }
+        }
     }
-    return true;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -2,20 +2,42 @@
 #define SHADER_HPP
 
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "../gl-state-cache.hpp"
+#include "../profiler.hpp"
+#include "program-binary-cache.hpp"
+
 namespace our
 {
 
+    // A precomputed handle to a uniform in a specific shader program.
+    // It can be retrieved once using "ShaderProgram::getUniformId" and then used every frame
+    // to set the uniform without any string lookup or driver round-trip.
+    struct UniformId
+    {
+        GLint location = -1; // -1 means that the uniform is not active in the program (setting it does nothing)
+    };
+
     class ShaderProgram
     {
 
     private:
         // Shader Program Handle (OpenGL object name)
         GLuint program;
+        // The locations of all the active uniforms in the program, collected once after linking
+        // Array uniforms are stored under their full name (e.g. "weights[2]") and their base name (e.g. "weights")
+        std::unordered_map<std::string, GLint> uniformLocations;
+        // The stages attached since the last link. They are only compiled by "link" if the program is not in the binary cache
+        std::vector<ShaderSource> sources;
+
+        // Reads all the active uniforms from the linked program and fills "uniformLocations"
+        void cacheUniformLocations();
 
     public:
         ShaderProgram()
@@ -27,66 +49,109 @@ namespace our
         {
             // TODO: (Req 1) Delete a shader program
             if (this->program != 0)
+            {
+                GLStateCache::forgetProgram(this->program);
                 glDeleteProgram(this->program);
+            }
         }
 
-        bool attach(const std::string &filename, GLenum type) const;
+        // Reads the shader stage from the given file (expanding its includes and adding the given defines, see "shader_utils::preprocess")
+        // Returns false if the file couldn't be read. The stage is compiled by "link" (so the compilation errors are reported by "link")
+        bool attach(const std::string &filename, GLenum type, const std::vector<std::string> &defines = {});
 
-        bool link() const;
+        // Loads the program from the binary cache (see "ProgramBinaryCache") or compiles the attached stages and links them
+        // Returns false if a stage failed to compile or the program failed to link
+        bool link();
 
+        // Makes this program the current program (nothing happens if it is already the current program)
         void use()
         {
-            glUseProgram(program);
+            GLStateCache::useProgram(program);
+        }
+
+        // Get the internal OpenGL name of the program (it is small and unique among the living programs)
+        GLuint getOpenGLName() const
+        {
+            return program;
         }
 
-        GLuint getUniformLocation(const std::string &name)
+        GLint getUniformLocation(const std::string &name) const
         {
             // TODO: (Req 1) Return the location of the uniform with the given name
-            return glGetUniformLocation(this->program, name.c_str());
+            // The locations are cached after linking so we don't need to ask the driver every time
+            if (auto it = uniformLocations.find(name); it != uniformLocations.end())
+                return it->second;
+            return -1;
+        }
+
+        // Returns a handle to the given uniform that can be stored and reused to set the uniform
+        UniformId getUniformId(const std::string &name) const
+        {
+            return UniformId{getUniformLocation(name)};
+        }
+
+        // Connects the uniform block with the given name to the given binding point
+        // The buffer bound to that point (using glBindBufferBase) will be used to fill the block
+        // If the program has no active block with that name, nothing happens
+        void bindUniformBlock(const std::string &name, GLuint binding) const
+        {
+            GLuint index = glGetUniformBlockIndex(this->program, name.c_str());
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(this->program, index, binding);
         }
 
         void set(const std::string &uniform, GLfloat value)
         {
             // TODO: (Req 1) Send the given float value to the given uniform
-            glUniform1f(getUniformLocation(uniform), value);
+            set(getUniformId(uniform), value);
         }
 
         void set(const std::string &uniform, GLuint value)
         {
             // TODO: (Req 1) Send the given unsigned integer value to the given uniform
-             glUniform1ui(getUniformLocation(uniform), value);
+            set(getUniformId(uniform), value);
         }
 
         void set(const std::string &uniform, GLint value)
         {
             // TODO: (Req 1) Send the given integer value to the given uniform
-             glUniform1i(getUniformLocation(uniform), value);
+            set(getUniformId(uniform), value);
         }
 
         void set(const std::string &uniform, glm::vec2 value)
         {
             // TODO: (Req 1) Send the given 2D vector value to the given uniform
-            glUniform2fv(getUniformLocation(uniform), 1, glm::value_ptr(value));
+            set(getUniformId(uniform), value);
         }
 
         void set(const std::string &uniform, glm::vec3 value)
         {
             // TODO: (Req 1) Send the given 3D vector value to the given uniform
-            glUniform3fv(getUniformLocation(uniform), 1, glm::value_ptr(value));
+            set(getUniformId(uniform), value);
         }
 
         void set(const std::string &uniform, glm::vec4 value)
         {
             // TODO: (Req 1) Send the given 4D vector value to the given uniform
-            glUniform4fv(getUniformLocation(uniform), 1, glm::value_ptr(value));
+            set(getUniformId(uniform), value);
         }
 
         void set(const std::string &uniform, glm::mat4 matrix)
         {
             // TODO: (Req 1) Send the given matrix 4x4 value to the given uniform
-            glUniformMatrix4fv(getUniformLocation(uniform), 1, GL_FALSE, &matrix[0][0]);
+            set(getUniformId(uniform), matrix);
         }
 
+        // These overloads set a uniform using a precomputed handle (see "getUniformId")
+        // Every call is counted by the "Profiler" (all the string overloads go through them)
+        void set(UniformId uniform, GLfloat value) { Profiler::count(ProfileCounter::UniformSets); glUniform1f(uniform.location, value); }
+        void set(UniformId uniform, GLuint value) { Profiler::count(ProfileCounter::UniformSets); glUniform1ui(uniform.location, value); }
+        void set(UniformId uniform, GLint value) { Profiler::count(ProfileCounter::UniformSets); glUniform1i(uniform.location, value); }
+        void set(UniformId uniform, glm::vec2 value) { Profiler::count(ProfileCounter::UniformSets); glUniform2fv(uniform.location, 1, glm::value_ptr(value)); }
+        void set(UniformId uniform, glm::vec3 value) { Profiler::count(ProfileCounter::UniformSets); glUniform3fv(uniform.location, 1, glm::value_ptr(value)); }
+        void set(UniformId uniform, glm::vec4 value) { Profiler::count(ProfileCounter::UniformSets); glUniform4fv(uniform.location, 1, glm::value_ptr(value)); }
+        void set(UniformId uniform, const glm::mat4 &matrix) { Profiler::count(ProfileCounter::UniformSets); glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &matrix[0][0]); }
+
         // TODO: (Req 1) Delete the copy constructor and assignment operator.
         // Question: Why do we delete the copy constructor and assignment operator?
 
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "../ecs/world.hpp"
+#include "../components/collider.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+namespace our
+{
+
+    // An axis aligned box in world space
+    struct AABB {
+        glm::vec3 min, max;
+
+        // Returns true if the two boxes overlap (touching boxes don't overlap)
+        bool overlaps(const AABB& other) const {
+            return min.x < other.max.x && max.x > other.min.x &&
+                   min.y < other.max.y && max.y > other.min.y &&
+                   min.z < other.max.z && max.z > other.min.z;
+        }
+    };
+
+    // The collision system is a broad-phase for every entity which contains a ColliderComponent.
+    // Each frame, the collider boxes are inserted into a uniform grid on the XZ plane (the ground plane of the game),
+    // so an overlap query only tests the colliders in the cells covered by the queried box instead of every collider in the world.
+    // For more information, see "common/components/collider.hpp"
+    class CollisionSystem {
+        // A collider as stored in the grid
+        struct Proxy {
+            Entity* entity;
+            AABB box;
+            std::uint32_t layerMask;
+            std::uint32_t queryStamp; // The last query that visited this proxy (so a proxy in many cells is returned once)
+        };
+
+        // Boxes that cover more than this number of cells along X or Z are not inserted in the grid,
+        // instead they are tested by every query (this avoids filling thousands of cells for huge colliders)
+        static constexpr int MAX_CELLS_PER_AXIS = 64;
+
+        float cellSize = 2.0f; // The size of a grid cell along X and Z
+        std::vector<Proxy> proxies; // The colliders of the last update (in the order of the world's collider view)
+        std::unordered_map<std::int64_t, std::vector<std::uint32_t>> cells; // The proxy indices in each cell
+        std::vector<std::uint32_t> oversized; // The proxies that are too large to be inserted in the grid
+        std::vector<std::uint32_t> candidates; // A scratch list used by "query"
+        std::uint32_t queryStamp = 0;
+
+        // Returns the cell coordinate that contains the given coordinate (along X or Z)
+        int toCell(float value) const {
+            return (int)std::floor(value / cellSize);
+        }
+
+        // Packs the 2D cell coordinates into a single key
+        static std::int64_t toKey(int x, int z) {
+            return (std::int64_t(x) << 32) | std::int64_t(std::uint32_t(z));
+        }
+
+    public:
+
+        // Changes the size of the grid cells. It should be roughly the size of the common colliders.
+        // The change is applied on the next call to "update".
+        void setCellSize(float size) {
+            if(size > 0) cellSize = size;
+        }
+
+        // Computes the world space box of the given entity's collider using its current transform
+        // Returns false if the entity has no collider
+        static bool getBox(Entity* entity, AABB& box) {
+            ColliderComponent* collider = entity->getComponent<ColliderComponent>();
+            if(!collider) return false;
+            glm::vec3 center = glm::vec3(entity->getLocalToWorldMatrix()[3]) + collider->center;
+            box.min = center - collider->extent;
+            box.max = center + collider->extent;
+            return true;
+        }
+
+        // This should be called every frame (after the entities moved) to rebuild the grid from the colliders in the world
+        void update(World* world) {
+            proxies.clear();
+            oversized.clear();
+            // The cells are emptied but kept, so their memory is reused by the next frames
+            for(auto& [key, cell] : cells) cell.clear();
+
+            for(auto entity : world->view<ColliderComponent>()){
+                AABB box;
+                getBox(entity, box);
+                std::uint32_t index = (std::uint32_t)proxies.size();
+                proxies.push_back({entity, box, entity->getComponent<ColliderComponent>()->layerMask, queryStamp});
+
+                int minX = toCell(box.min.x), maxX = toCell(box.max.x);
+                int minZ = toCell(box.min.z), maxZ = toCell(box.max.z);
+                if(maxX - minX >= MAX_CELLS_PER_AXIS || maxZ - minZ >= MAX_CELLS_PER_AXIS){
+                    oversized.push_back(index);
+                    continue;
+                }
+                for(int x = minX; x <= maxX; x++)
+                    for(int z = minZ; z <= maxZ; z++)
+                        cells[toKey(x, z)].push_back(index);
+            }
+        }
+
+        // Fills "result" with the entities whose colliders overlap the given box and belong to one of the layers in "layerMask"
+        // The entities are returned in the same order as the world's collider view (so the results are deterministic)
+        // The colliders' boxes are the ones computed in the last call to "update"
+        void query(const AABB& box, std::uint32_t layerMask, std::vector<Entity*>& result) {
+            result.clear();
+            candidates.clear();
+            queryStamp++;
+            auto visit = [&](std::uint32_t index){
+                Proxy& proxy = proxies[index];
+                if(proxy.queryStamp == queryStamp) return;
+                proxy.queryStamp = queryStamp;
+                if((proxy.layerMask & layerMask) && proxy.box.overlaps(box))
+                    candidates.push_back(index);
+            };
+
+            int minX = toCell(box.min.x), maxX = toCell(box.max.x);
+            int minZ = toCell(box.min.z), maxZ = toCell(box.max.z);
+            if(maxX - minX >= MAX_CELLS_PER_AXIS || maxZ - minZ >= MAX_CELLS_PER_AXIS){
+                // The queried box is huge, so it is cheaper to test every proxy
+                for(std::uint32_t index = 0; index < proxies.size(); index++) visit(index);
+            } else {
+                for(int x = minX; x <= maxX; x++)
+                    for(int z = minZ; z <= maxZ; z++){
+                        auto it = cells.find(toKey(x, z));
+                        if(it == cells.end()) continue;
+                        for(auto index : it->second) visit(index);
+                    }
+                for(auto index : oversized) visit(index);
+            }
+
+            std::sort(candidates.begin(), candidates.end());
+            for(auto index : candidates) result.push_back(proxies[index].entity);
+        }
+
+        // Same as above but the box is the given entity's collider (at its current position)
+        // The entity itself is never returned
+        void query(Entity* entity, std::uint32_t layerMask, std::vector<Entity*>& result) {
+            AABB box;
+            if(!getBox(entity, box)){
+                result.clear();
+                return;
+            }
+            query(box, layerMask, result);
+            result.erase(std::remove(result.begin(), result.end(), entity), result.end());
+        }
+
+    };
+
+}
@@ -1,6 +1,10 @@
 #include "forward-renderer.hpp"
 #include "../mesh/mesh-utils.hpp"
 #include "../texture/texture-utils.hpp"
+#include "../asset-cache.hpp"
+#include "../profiler.hpp"
+#include "../deserialize-utils.hpp"
+#include "../shader/shader-utils.hpp"
 
 namespace our
 {
@@ -9,6 +13,35 @@ namespace our
     {
         // First, we store the window size for later use
         this->windowSize = windowSize;
+        // The frustum culling can be disabled from the configuration (e.g. to compare the performance)
+        frustumCulling = config.value("frustumCulling", true);
+        // The depth pre-pass is optional since it only pays off when the scene has enough overdraw of expensive shaders
+        depthPrepass = config.value("depthPrepass", false);
+        if (depthPrepass)
+        {
+            depthShader = acquireShader("assets/shaders/depth-only.vert", "assets/shaders/depth-only.frag");
+            depthInstancedShader = acquireShader("assets/shaders/depth-only.vert", "assets/shaders/depth-only.frag", {"INSTANCED"});
+            depthShader->bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+            depthInstancedShader->bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+            depthShaderM = depthShader->getUniformId("M");
+        }
+
+        // Create the uniform buffers that hold the per-frame camera and lighting data of the lighted shaders
+        glGenBuffers(1, &cameraUniformBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, cameraUniformBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), nullptr, GL_DYNAMIC_DRAW);
+        glGenBuffers(1, &lightingUniformBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, lightingUniformBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(LightingBlock), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        // The lights are clustered in a grid of [tiles along x, tiles along y, depth slices] e.g. "clusters": [16, 9, 24]
+        lightClusters.initialize(config.value("clusters", glm::ivec3(16, 9, 24)));
+        // The shadows are only drawn if the config has a "shadows" object (see "ShadowMaps" for its options)
+        shadowMaps.initialize(config.value("shadows", nlohmann::json()));
+
+        // Create the buffer that holds the per-instance model matrices of the instanced draws (it grows when needed)
+        glGenBuffers(1, &instanceBuffer);
 
         // Then we check if there is a sky texture in the configuration
         if (config.contains("sky"))
@@ -17,10 +50,8 @@ namespace our
             this->skySphere = mesh_utils::sphere(glm::ivec2(16, 16));
 
             // We can draw the sky using the same shader used to draw textured objects
-            ShaderProgram *skyShader = new ShaderProgram();
-            skyShader->attach("assets/shaders/textured.vert", GL_VERTEX_SHADER);
-            skyShader->attach("assets/shaders/textured.frag", GL_FRAGMENT_SHADER);
-            skyShader->link();
+            // (it is shared through the asset cache so it is only compiled once)
+            ShaderProgram *skyShader = acquireShader("assets/shaders/textured.vert", "assets/shaders/textured.frag");
 
             // TODO: (Req 10) Pick the correct pipeline state to draw the sky
             //  Hints: the sky will be draw after the opaque objects so we would need depth testing but which depth funtion should we pick?
@@ -37,7 +68,7 @@ namespace our
 
             // Load the sky texture (note that we don't need mipmaps since we want to avoid any unnecessary blurring while rendering the sky)
             std::string skyTextureFile = config.value<std::string>("sky", "");
-            Texture2D *skyTexture = texture_utils::loadImage(skyTextureFile, false);
+            Texture2D *skyTexture = acquireTexture(skyTextureFile, false);
 
             // Setup a sampler for the sky
             Sampler *skySampler = new Sampler();
@@ -74,7 +105,7 @@ namespace our
             glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTarget->getOpenGLName(), 0);
 
             // TODO: (Req 11) Unbind the framebuffer just to be safe
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLStateCache::getDefaultFramebuffer());
 
             // Create a vertex array to use for drawing the texture
             glGenVertexArrays(1, &postProcessVertexArray);
@@ -86,15 +117,66 @@ namespace our
             postprocessSampler->set(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
             postprocessSampler->set(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-            // Create the post processing shader
-            ShaderProgram *postprocessShader = new ShaderProgram();
-            postprocessShader->attach("assets/shaders/fullscreen.vert", GL_VERTEX_SHADER);
-            postprocessShader->attach(config.value<std::string>("postprocess", ""), GL_FRAGMENT_SHADER);
-            postprocessShader->link();
+            // The constants of the effects can be overriden by defines, e.g. "postprocessDefines": { "radial-blur": { "STEPS": 8 } }
+            if (config.contains("postprocessDefines") && config["postprocessDefines"].is_object())
+                for (auto &[name, defines] : config["postprocessDefines"].items())
+                    postprocessDefines[name] = shader_utils::parseDefines(defines);
+
+            // Compile all the built-in post processing effects once (instead of compiling a shader every frame)
+            // Each effect also gets a chain that only contains it and is named after it
+            for (const std::string name : {"grayscale", "radial-blur", "speed", "vignette", "chromatic-aberration"})
+            {
+                PostprocessHandle effect = registerPostprocessEffect(name, "assets/shaders/postprocess/" + name + ".frag");
+                registerPostprocessChain(name, {effect});
+            }
+
+            // The "postprocess" value is the effect applied by default. It can be a built-in effect or a path to any fragment shader
+            std::string defaultEffect = config.value<std::string>("postprocess", "");
+            registerPostprocessChain("default", {registerPostprocessEffect(defaultEffect, defaultEffect)});
+            // These are the chains used by the game effects unless they are overriden in the configuration
+            registerPostprocessChain("death", {postprocessEffectNames["grayscale"]});
+            registerPostprocessChain("star", {postprocessEffectNames["radial-blur"]});
+            registerPostprocessChain("speed", {postprocessEffectNames["speed"]});
+
+            // Named chains can be defined in the configuration in the form:
+            //    "postprocessChains": { chain_name : [effect_name_or_path, ...], ... }
+            if (config.contains("postprocessChains") && config["postprocessChains"].is_object())
+            {
+                for (auto &[name, desc] : config["postprocessChains"].items())
+                {
+                    if (!desc.is_array())
+                        continue;
+                    std::vector<PostprocessHandle> effects;
+                    for (auto &effect : desc)
+                    {
+                        std::string effectName = effect.get<std::string>();
+                        effects.push_back(registerPostprocessEffect(effectName, effectName));
+                    }
+                    if (!effects.empty())
+                        registerPostprocessChain(name, effects);
+                }
+            }
+            defaultChain = getPostprocessChain("default");
+            deathChain = getPostprocessChain("death");
+            starChain = getPostprocessChain("star");
+            speedChain = getPostprocessChain("speed");
+
+            // If any chain has more than one effect, we need a second color target to ping-pong between the passes
+            for (const auto &chain : postprocessChains)
+            {
+                if (chain.size() > 1 && pingPongTarget == nullptr)
+                {
+                    glGenFramebuffers(1, &pingPongFrameBuffer);
+                    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, pingPongFrameBuffer);
+                    pingPongTarget = texture_utils::empty(GL_RGBA8, windowSize);
+                    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingPongTarget->getOpenGLName(), 0);
+                    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLStateCache::getDefaultFramebuffer());
+                }
+            }
 
             // Create a post processing material
             postprocessMaterial = new TexturedMaterial();
-            postprocessMaterial->shader = postprocessShader;
+            postprocessMaterial->shader = postprocessEffects[postprocessChains[defaultChain].front()];
             postprocessMaterial->texture = colorTarget;
             postprocessMaterial->sampler = postprocessSampler;
             // The default options are fine but we don't need to interact with the depth buffer
@@ -105,12 +187,27 @@ namespace our
 
     void ForwardRenderer::destroy()
     {
+        // The cached uniform handles belong to shaders that may be deleted after the renderer is destroyed
+        lightedUniforms.clear();
+        glDeleteBuffers(1, &cameraUniformBuffer);
+        glDeleteBuffers(1, &lightingUniformBuffer);
+        lightClusters.destroy();
+        shadowMaps.destroy();
+        if (depthShader)
+        {
+            AssetCache::release(depthShader);
+            AssetCache::release(depthInstancedShader);
+            depthShader = depthInstancedShader = nullptr;
+        }
+        glDeleteBuffers(1, &instanceBuffer);
+        instanceBufferCapacity = 0;
         // Delete all objects related to the sky
         if (skyMaterial)
         {
             delete skySphere;
-            delete skyMaterial->shader;
-            delete skyMaterial->texture;
+            // The shader and the texture stay in the asset cache for the next time the renderer is initialized
+            AssetCache::release(skyMaterial->shader);
+            AssetCache::release(skyMaterial->texture);
             delete skyMaterial->sampler;
             delete skyMaterial;
         }
@@ -122,57 +219,333 @@ namespace our
             delete colorTarget;
             delete depthTarget;
             delete postprocessMaterial->sampler;
-            delete postprocessMaterial->shader;
             delete postprocessMaterial;
+            for (auto effect : postprocessEffects)
+                AssetCache::release(effect);
+            postprocessEffects.clear();
+            postprocessEffectNames.clear();
+            postprocessDefines.clear();
+            postprocessChains.clear();
+            postprocessChainNames.clear();
+            if (pingPongTarget)
+            {
+                glDeleteFramebuffers(1, &pingPongFrameBuffer);
+                delete pingPongTarget;
+                pingPongTarget = nullptr;
+            }
         }
     }
 
-    void ForwardRenderer::render(World *world)
+    const ForwardRenderer::LightedUniforms &ForwardRenderer::getLightedUniforms(ShaderProgram *shader)
     {
-        // First of all, we search for a camera and for all the mesh renderers
-        CameraComponent *camera = nullptr;
-        opaqueCommands.clear();
-        transparentCommands.clear();
-        lightComponents.clear();
-        for (auto entity : world->getEntities())
+        // The uniform handles are looked up once per shader, so the hot loop never looks up uniform names
+        if (auto it = lightedUniforms.find(shader); it != lightedUniforms.end())
+            return it->second;
+
+        // This is the first time we see this shader, so we connect its uniform blocks to the renderer's buffers
+        shader->bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+        shader->bindUniformBlock("Lighting", LIGHTING_BLOCK_BINDING);
+        // and its light samplers to the units of the cluster buffers (the shader is in use when this is called)
+        shader->set("light_data", (GLint)LIGHT_DATA_UNIT);
+        shader->set("cluster_grid", (GLint)CLUSTER_GRID_UNIT);
+        shader->set("cluster_lights", (GLint)CLUSTER_LIGHTS_UNIT);
+        shader->bindUniformBlock("Shadows", SHADOWS_BLOCK_BINDING);
+        shader->set("shadow_atlas", (GLint)SHADOW_ATLAS_UNIT);
+
+        LightedUniforms &uniforms = lightedUniforms[shader];
+        uniforms.M = shader->getUniformId("M");
+        uniforms.M_IT = shader->getUniformId("M_IT");
+        return uniforms;
+    }
+
+    void ForwardRenderer::setupLightedCommand(LightMaterial *material, const RenderCommand &command)
+    {
+        material->setup();
+        const LightedUniforms &uniforms = getLightedUniforms(material->shader);
+        // The camera, sky and light data are already in the uniform buffers, so we only send the model matrices
+        // send the model matrix to the shader
+        material->shader->set(uniforms.M, command.localToWorld);
+        // send the model view matrix to the shader
+        material->shader->set(uniforms.M_IT, glm::transpose(glm::inverse(command.localToWorld)));
+    }
+
+    void ForwardRenderer::drawCommand(const RenderCommand &command, const glm::mat4 &VP, bool depthEqual)
+    {
+        // check if the command  is a lighted material or not
+        if (auto material = dynamic_cast<LightMaterial *>(command.material))
+        {
+            setupLightedCommand(material, command);
+        }
+        else
+        {
+            glm::mat4 modelViewProjection = VP * command.localToWorld;
+            command.material->setup();
+            command.material->shader->set("transform", modelViewProjection);
+        }
+        if (depthEqual)
+        {
+            // The depth is already in the buffer, so we only keep the fragments that produced it
+            GLStateCache::depthFunc(GL_EQUAL);
+            GLStateCache::depthMask(false);
+        }
+
+        command.mesh->draw();
+    }
+
+    bool ForwardRenderer::usesDepthPrepass(const Material *material)
+    {
+        // Only the lighted shader is expensive enough to be worth it, and it never discards fragments (so depth only is enough)
+        return dynamic_cast<const LightMaterial *>(material) && !material->transparent &&
+               material->pipelineState.depthTesting.enabled && material->pipelineState.depthMask;
+    }
+
+    void ForwardRenderer::drawDepthPrepass()
+    {
+        for (auto &batch : opaqueBatches)
         {
-            // If we hadn't found a camera yet, we look for a camera in this entity
-            if (!camera)
-                camera = entity->getComponent<CameraComponent>();
-            // If this entity has a mesh renderer component
-            if (auto meshRenderer = entity->getComponent<MeshRendererComponent>(); meshRenderer)
+            if (!batch.depthPrepass)
+                continue;
+            const RenderCommand &command = opaqueCommands[batch.first];
+            // Keep the material's culling and depth test, but write no color
+            PipelineState state = command.material->pipelineState;
+            state.blending.enabled = false;
+            state.colorMask = glm::bvec4(false);
+            state.setup();
+            if (batch.instanced)
             {
-                if (auto light = entity->getComponent<LightComponent>(); light)
-                {
-                    lightComponents.push_back(light);
-                }
-                // We construct a command from it
-                RenderCommand command;
-                command.localToWorld = meshRenderer->getOwner()->getLocalToWorldMatrix();
-                command.center = glm::vec3(command.localToWorld * glm::vec4(0, 0, 0, 1));
-                command.mesh = meshRenderer->mesh;
-                command.material = meshRenderer->material;
-                // if it is transparent, we add it to the transparent commands list
-                if (command.material->transparent)
-                {
-                    transparentCommands.push_back(command);
-                }
-                else
+                depthInstancedShader->use();
+                command.mesh->drawInstanced(instanceBuffer, batch.instanceOffset, (GLsizei)batch.count);
+                continue;
+            }
+            depthShader->use();
+            for (size_t index = batch.first; index < batch.first + batch.count; index++)
+            {
+                depthShader->set(depthShaderM, opaqueCommands[index].localToWorld);
+                opaqueCommands[index].mesh->draw();
+            }
+        }
+    }
+
+    std::uint64_t ForwardRenderer::getOpaqueSortKey(const RenderCommand &command, const glm::vec3 &eye, const glm::vec3 &forward, float far)
+    {
+        // The OpenGL names are small integers, so keeping their lower bits is enough to tell them apart in most scenes
+        // (a collision only makes the order less optimal, it never changes what is drawn)
+        std::uint64_t shader = command.material->shader ? command.material->shader->getOpenGLName() : 0;
+        std::uint64_t pipeline = command.material->pipelineState.getSortKey();
+        std::uint64_t texture = command.material->getSortTexture();
+        std::uint64_t mesh = command.mesh->getVertexArray();
+        // The distance along the camera forward direction mapped to [0, 1] then quantized
+        float distance = glm::clamp(glm::dot(command.center - eye, forward) / far, 0.0f, 1.0f);
+        std::uint64_t depth = (std::uint64_t)(distance * float((1 << 22) - 1));
+        return ((shader & 0x3FF) << 54) | ((pipeline & 0xFFF) << 42) | ((texture & 0x3FF) << 32) | ((mesh & 0x3FF) << 22) | depth;
+    }
+
+    void ForwardRenderer::buildOpaqueBatches()
+    {
+        OUR_PROFILE_SCOPE("Batching");
+        opaqueBatches.clear();
+        instanceData.clear();
+        // Sorting by the keys puts the commands that share a material and a mesh next to each other
+        // (the opaque objects can be drawn in any order since they are depth tested)
+        std::sort(opaqueCommands.begin(), opaqueCommands.end(), [](const RenderCommand &first, const RenderCommand &second)
+                  { return first.sortKey < second.sortKey; });
+
+        for (size_t first = 0; first < opaqueCommands.size();)
+        {
+            const RenderCommand &command = opaqueCommands[first];
+            size_t last = first + 1;
+            while (last < opaqueCommands.size() && opaqueCommands[last].material == command.material && opaqueCommands[last].mesh == command.mesh)
+                last++;
+
+            RenderBatch batch{first, last - first, false, 0, depthPrepass && usesDepthPrepass(command.material)};
+            // A single object is cheaper to draw without instancing
+            if (batch.count > 1 && command.material->instancedShader)
+            {
+                batch.instanced = true;
+                batch.instanceOffset = (GLintptr)(instanceData.size() * sizeof(InstanceData));
+                for (size_t index = first; index < last; index++)
                 {
-                    // Otherwise, we add it to the opaque command list
-                    opaqueCommands.push_back(command);
+                    const glm::mat4 &M = opaqueCommands[index].localToWorld;
+                    instanceData.push_back({M, glm::transpose(glm::inverse(M))});
                 }
             }
+            opaqueBatches.push_back(batch);
+            first = last;
+        }
+
+        if (instanceData.empty())
+            return;
+        // Upload the instance data of all the batches at once
+        GLsizeiptr size = (GLsizeiptr)(instanceData.size() * sizeof(InstanceData));
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        if (size > instanceBufferCapacity)
+        {
+            // Grow with some slack so that a few more objects don't reallocate the buffer every frame
+            instanceBufferCapacity = size + size / 2;
+            glBufferData(GL_ARRAY_BUFFER, instanceBufferCapacity, nullptr, GL_STREAM_DRAW);
+        }
+        else
+        {
+            // Orphan the old storage so that we don't wait for the previous frame's draws to finish reading it
+            glBufferData(GL_ARRAY_BUFFER, instanceBufferCapacity, nullptr, GL_STREAM_DRAW);
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, instanceData.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    PostprocessHandle ForwardRenderer::registerPostprocessEffect(const std::string &name, const std::string &path)
+    {
+        // If the effect was already compiled (by name or by path), we reuse it
+        if (auto it = postprocessEffectNames.find(name); it != postprocessEffectNames.end())
+            return it->second;
+        if (auto it = postprocessEffectNames.find(path); it != postprocessEffectNames.end())
+            return postprocessEffectNames[name] = it->second;
+
+        std::vector<std::string> defines;
+        if (auto it = postprocessDefines.find(name); it != postprocessDefines.end())
+            defines = it->second;
+        ShaderProgram *effect = acquireShader("assets/shaders/fullscreen.vert", path, defines);
+
+        PostprocessHandle handle = (PostprocessHandle)postprocessEffects.size();
+        postprocessEffects.push_back(effect);
+        postprocessEffectNames[name] = handle;
+        postprocessEffectNames[path] = handle;
+        return handle;
+    }
+
+    PostprocessHandle ForwardRenderer::registerPostprocessChain(const std::string &name, const std::vector<PostprocessHandle> &effects)
+    {
+        // If a chain with the same name exists, we replace its effects but keep its handle
+        if (auto it = postprocessChainNames.find(name); it != postprocessChainNames.end())
+        {
+            postprocessChains[it->second] = effects;
+            return it->second;
+        }
+        PostprocessHandle handle = (PostprocessHandle)postprocessChains.size();
+        postprocessChains.push_back(effects);
+        postprocessChainNames[name] = handle;
+        return handle;
+    }
+
+    PostprocessHandle ForwardRenderer::getPostprocessChain(const std::string &name) const
+    {
+        if (auto it = postprocessChainNames.find(name); it != postprocessChainNames.end())
+            return it->second;
+        return -1;
+    }
+
+    void ForwardRenderer::applyPostprocessChain(PostprocessHandle chain)
+    {
+        const auto &effects = postprocessChains[chain];
+        glBindVertexArray(postProcessVertexArray);
+        Texture2D *source = colorTarget;
+        for (size_t i = 0; i < effects.size(); i++)
+        {
+            // The last pass draws to the default framebuffer while the intermediate passes
+            // alternate between the ping-pong target and the scene color target
+            Texture2D *destination = nullptr;
+            GLuint frameBuffer = GLStateCache::getDefaultFramebuffer();
+            if (i + 1 < effects.size())
+            {
+                destination = source == colorTarget ? pingPongTarget : colorTarget;
+                frameBuffer = source == colorTarget ? pingPongFrameBuffer : postprocessFrameBuffer;
+            }
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameBuffer);
+
+            postprocessMaterial->shader = postprocessEffects[effects[i]];
+            postprocessMaterial->texture = source;
+            postprocessMaterial->setup();
+            Profiler::count(ProfileCounter::DrawCalls);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            source = destination;
         }
+    }
+
+    void ForwardRenderer::render(World *world, float interpolation)
+    {
+        OUR_PROFILE_SCOPE("Render");
+        // First of all, we search for a camera and for all the mesh renderers
+        CameraComponent *camera = nullptr;
+        opaqueCommands.clear();
+        transparentCommands.clear();
+        lightComponents.clear();
+        // Refresh the cached world matrices once (the systems may have moved some entities this frame)
+        // The entities are drawn between their previous and current fixed step transforms
+        world->updateTransforms(interpolation);
+        // The world keeps cached views, so we only visit the entities that have the components we need
+        // Every light is collected (not only the ones attached to a mesh), the clusters decide which fragments they reach
+        for (auto entity : world->view<LightComponent>())
+            lightComponents.push_back(entity->getComponent<LightComponent>());
+        if (const auto &cameras = world->view<CameraComponent>(); !cameras.empty())
+            camera = cameras.front()->getComponent<CameraComponent>();
 
         // If there is no camera, we return (we cannot render without a camera)
         if (camera == nullptr)
             return;
 
+        // TODO: (Req 9) Get the camera ViewProjection matrix and store it in VP
+        glm::mat4 viewMatrix = camera->getViewMatrix();
+        glm::mat4 projectionMatrix = camera->getProjectionMatrix(windowSize);
+        glm::mat4 VP = projectionMatrix * viewMatrix;
+
+        // Collect the mesh renderers with their world space bounding spheres, then test all the spheres against the
+        // view frustum at once. Only the visible mesh renderers become render commands.
+        {
+            OUR_PROFILE_SCOPE("Culling");
+            cullCandidates.clear();
+            sphereCuller.clear();
+            for (auto entity : world->view<MeshRendererComponent>())
+            {
+                auto meshRenderer = entity->getComponent<MeshRendererComponent>();
+                const glm::mat4 &localToWorld = entity->getRenderMatrix();
+                // The sphere radius is scaled by the largest scale of the model matrix so that the sphere still contains the mesh
+                float scale = glm::max(glm::length(glm::vec3(localToWorld[0])), glm::max(glm::length(glm::vec3(localToWorld[1])), glm::length(glm::vec3(localToWorld[2]))));
+                const MeshBounds &bounds = meshRenderer->mesh->getBounds();
+                glm::vec3 center = glm::vec3(localToWorld * glm::vec4(bounds.sphereCenter, 1.0f));
+                cullCandidates.push_back(meshRenderer);
+                sphereCuller.add(center, bounds.sphereRadius * scale);
+            }
+            if (frustumCulling)
+            {
+                cullingStats.visible = sphereCuller.cull(Frustum::fromViewProjection(VP));
+            }
+            else
+            {
+                cullingStats.visible = cullCandidates.size();
+            }
+            cullingStats.culled = cullCandidates.size() - cullingStats.visible;
+            Profiler::count(ProfileCounter::VisibleObjects, cullingStats.visible);
+            Profiler::count(ProfileCounter::CulledObjects, cullingStats.culled);
+        }
+
+        for (size_t index = 0; index < cullCandidates.size(); index++)
+        {
+            if (frustumCulling && !sphereCuller.isVisible(index))
+                continue;
+            auto meshRenderer = cullCandidates[index];
+            // We construct a command from it
+            RenderCommand command;
+            command.localToWorld = meshRenderer->getOwner()->getRenderMatrix();
+            command.center = glm::vec3(command.localToWorld * glm::vec4(0, 0, 0, 1));
+            command.mesh = meshRenderer->mesh;
+            command.material = meshRenderer->material;
+            // if it is transparent, we add it to the transparent commands list
+            if (command.material->transparent)
+            {
+                transparentCommands.push_back(command);
+            }
+            else
+            {
+                // Otherwise, we add it to the opaque command list
+                opaqueCommands.push_back(command);
+            }
+        }
+
         // TODO: (Req 9) Modify the following line such that "cameraForward" contains a vector pointing the camera forward direction
         //  HINT: See how you wrote the CameraComponent::getViewMatrix, it should help you solve this one
 
-        auto localToWorldMatrix = camera->getOwner()->getLocalToWorldMatrix();
+        auto localToWorldMatrix = camera->getOwner()->getRenderMatrix();
         glm::vec3 centerTransparency = localToWorldMatrix * glm::vec4(0.0, 0.0, -1.0, 1.0);
         glm::vec3 eyeTransparency = localToWorldMatrix * glm::vec4(0.0, 0.0, 0.0, 1.0);
         glm::vec3 cameraForward = localToWorldMatrix * glm::vec4(0.0, 0.0, -1.0, 0.0); // vector
@@ -186,10 +559,40 @@ namespace our
 
         return distanceToFirst > distanceToSecond; });
 
-        // TODO: (Req 9) Get the camera ViewProjection matrix and store it in VP
-        glm::mat4 viewMatrix = camera->getViewMatrix();
-        glm::mat4 projectionMatrix = camera->getProjectionMatrix(windowSize);
-        glm::mat4 VP = projectionMatrix * viewMatrix;
+        // Compute the opaque sort keys (the depth part needs the camera)
+        for (auto &command : opaqueCommands)
+            command.sortKey = getOpaqueSortKey(command, eyeTransparency, cameraForward, camera->far);
+
+        // Fill the per-frame camera, sky and light data once and upload it to the uniform buffers
+        // All the lighted draws of this frame read this data from the buffers bound to the fixed binding points
+        cameraBlock.VP = VP;
+        cameraBlock.eye = eyeTransparency;
+        // sky light color data
+        lightingBlock.skyTop = glm::vec3(0.0f, 1.0f, 0.5f);
+        lightingBlock.skyMiddle = glm::vec3(0.3f, 0.3f, 0.3f);
+        lightingBlock.skyBottom = glm::vec3(0.1f, 0.1f, 0.1f);
+        // Draw the shadow maps first since they need their own framebuffer and viewport
+        {
+            OUR_PROFILE_GPU_SCOPE("Shadows");
+            shadowMaps.update(world, lightComponents, viewMatrix, projectionMatrix, camera->near, camera->far, lightShadowViews);
+        }
+        // Bin the lights into the clusters of this camera and upload the light lists
+        lightClusters.update(lightComponents, lightShadowViews, viewMatrix, projectionMatrix, camera->near, camera->far, windowSize);
+        lightingBlock.clusterCount = lightClusters.getCount();
+        lightingBlock.clusterTileSize = lightClusters.getTileSize();
+        lightingBlock.clusterDepthScale = lightClusters.getDepthScale();
+        lightingBlock.clusterDepthBias = lightClusters.getDepthBias();
+        glm::vec3 viewForward = glm::normalize(cameraForward);
+        lightingBlock.viewDepthPlane = glm::vec4(viewForward, -glm::dot(viewForward, eyeTransparency));
+        glBindBuffer(GL_UNIFORM_BUFFER, cameraUniformBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &cameraBlock);
+        glBindBuffer(GL_UNIFORM_BUFFER, lightingUniformBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightingBlock), &lightingBlock);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, cameraUniformBuffer);
+        glBindBufferBase(GL_UNIFORM_BUFFER, LIGHTING_BLOCK_BINDING, lightingUniformBuffer);
+        lightClusters.bind();
+        shadowMaps.bind();
 
         // TODO: (Req 9) Set the OpenGL viewport using viewportStart and viewportSize
         glViewport(0, 0, this->windowSize.x, this->windowSize.y); // Determines the area of the window where OpenGL will draw.
@@ -200,8 +603,8 @@ namespace our
         glClearDepth(1.0f);
 
         // TODO: (Req 9) Set the color mask to true and the depth mask to true (to ensure the glClear will affect the framebuffer)
-        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-        glDepthMask(GL_TRUE);
+        GLStateCache::colorMask(glm::bvec4(true));
+        GLStateCache::depthMask(true);
 
         // If there is a postprocess material, bind the framebuffer
         if (postprocessMaterial)
@@ -215,90 +618,50 @@ namespace our
 
         // TODO: (Req 9) Draw all the opaque commands
         //  Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
-        for (auto &command : opaqueCommands)
+        buildOpaqueBatches();
+        if (depthPrepass)
         {
-            //* Responsible for rendering all the opaque objects in the scene
-
-            //? 1- calculates the model-view-projection matrix= multiplying the camera view-projection matrix VP by the local-to-world matrix of the object.
-            //? 2- sets up the material of the object by calling setup func. that sets the material properties
-            //? 3- binding to crossponding shader ("transform")
-            //? 4- draw mesh  to render object
-            // check if the command  is a lighted material or not
-
-            if (auto material = dynamic_cast<LightMaterial *>(command.material))
+            OUR_PROFILE_GPU_SCOPE("Depth prepass");
+            drawDepthPrepass();
+        }
+        {
+            OUR_PROFILE_GPU_SCOPE("Opaque");
+            for (auto &batch : opaqueBatches)
             {
-                if (material != nullptr)
+                //* Responsible for rendering all the opaque objects in the scene
+
+                //? 1- calculates the model-view-projection matrix= multiplying the camera view-projection matrix VP by the local-to-world matrix of the object.
+                //? 2- sets up the material of the object by calling setup func. that sets the material properties
+                //? 3- binding to crossponding shader ("transform")
+                //? 4- draw mesh  to render object
+                const RenderCommand &command = opaqueCommands[batch.first];
+                if (batch.instanced)
                 {
-                    material->setup();
-                    // vertex shader
-                    // send the camera position to the shader
-                    material->shader->set("eye", eyeTransparency);
-                    // send the view projection matrix to the shader
-                    material->shader->set("VP", VP);
-                    // send the model matrix to the shader
-                    material->shader->set("M", command.localToWorld);
-                    // send the model view matrix to the shader
-                    material->shader->set("M_IT", glm::transpose(glm::inverse(command.localToWorld)));
-                    // fragment shader
-                    // sky light color data
-                    // send the sky light color data to the shader
-                    material->shader->set("Sky.top", glm::vec3(0.0f, 1.0f, 0.5f));
-                    material->shader->set("Sky.middle", glm::vec3(0.3f, 0.3f, 0.3f));
-                    material->shader->set("Sky.bottom", glm::vec3(0.1f, 0.1f, 0.1f));
-                    //  send the light count
-                    material->shader->set("light_count", (GLint)lightComponents.size());
-                    // loop over the light components and send the light data to the shader
-                    for (auto i = 0; i < (int)lightComponents.size(); i++)
+                    // The instanced shaders read VP (and the lighting) from the uniform blocks and the model matrices from the instance buffer
+                    command.material->setup(true);
+                    getLightedUniforms(command.material->instancedShader);
+                    if (batch.depthPrepass)
                     {
-                        material->shader->set("lights[" + std::to_string(i) + "].type", (GLint)lightComponents[i]->LightType);
-                        // in case of directional light we need to send the direction of the light only
-                        if (lightComponents[i]->LightType == LightType::DIRECTIONAL)
-                        {
-                            // calculate the light direction in world space from entity component
-                            glm::vec3 directional_direction = glm::normalize(lightComponents[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(lightComponents[i]->direction, 0));
-                            material->shader->set("lights[" + std::to_string(i) + "].direction", directional_direction);
-                        }
-                        // in case of point light we need to send the position of the light only
-                        else if (lightComponents[i]->LightType == LightType::POINT)
-                        {
-                            glm::vec3 position = glm::vec3(lightComponents[i]->getOwner()->getLocalToWorldMatrix()[3]);
-                            material->shader->set("lights[" + std::to_string(i) + "].position", position);
-                        }
-                        // in case of spot light we need to send the position and direction of the light
-                        else if (lightComponents[i]->LightType == LightType::SPOT)
-                        {
-                            glm::vec3 directional_direction = glm::normalize(lightComponents[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(lightComponents[i]->direction, 0));
-                            // we multiply local to world matrix by (0,0,0,1) to get the vec3 and drop the w component
-                            glm::vec3 position = glm::vec3(lightComponents[i]->getOwner()->getLocalToWorldMatrix()[3]);
-                            material->shader->set("lights[" + std::to_string(i) + "].position", position);
-                            material->shader->set("lights[" + std::to_string(i) + "].direction", directional_direction);
-                            material->shader->set("lights[" + std::to_string(i) + "].cone_angles", lightComponents[i]->cone_angles);
-                        }
-                        
-                        material->shader->set("lights[" + std::to_string(i) + "].attenuation", lightComponents[i]->attenuation);
-                        material->shader->set("lights[" + std::to_string(i) + "].diffuse", lightComponents[i]->diffuse);
-                        material->shader->set("lights[" + std::to_string(i) + "].specular", lightComponents[i]->specular);
+                        GLStateCache::depthFunc(GL_EQUAL);
+                        GLStateCache::depthMask(false);
                     }
+                    command.mesh->drawInstanced(instanceBuffer, batch.instanceOffset, (GLsizei)batch.count);
+                    continue;
                 }
+                for (size_t index = batch.first; index < batch.first + batch.count; index++)
+                    drawCommand(opaqueCommands[index], VP, batch.depthPrepass);
             }
-            else
-            {
-                glm::mat4 modelViewProjection = VP * command.localToWorld;
-                command.material->setup();
-                command.material->shader->set("transform", modelViewProjection);
-            }
-
-            command.mesh->draw();
         }
 
         // If there is a sky material, draw the sky
         if (this->skyMaterial)
         {
+            OUR_PROFILE_GPU_SCOPE("Sky");
             // TODO: (Req 10) setup the sky material
             this->skyMaterial->setup();
 
             // TODO: (Req 10) Get the camera position
-            glm::vec3 cameraPosition = camera->getOwner()->getLocalToWorldMatrix() * glm::vec4(0, 0, 0, 1);
+            glm::vec3 cameraPosition = camera->getOwner()->getRenderMatrix() * glm::vec4(0, 0, 0, 1);
 
             // TODO: (Req 10) Create a model matrix for the sky such that it always follows the camera (sky sphere center = camera position)
             our::Transform skyTransform;
@@ -320,108 +683,26 @@ namespace our
         }
         // TODO: (Req 9) Draw all the transparent commands
         //  Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
-        for (auto &command : transparentCommands)
         {
-             if (auto material = dynamic_cast<LightMaterial *>(command.material))
+            OUR_PROFILE_GPU_SCOPE("Transparent");
+            for (auto &command : transparentCommands)
             {
-                if (material != nullptr)
-                {
-                    material->setup();
-                    // vertex shader
-                    // send the camera position to the shader
-                    material->shader->set("eye", eyeTransparency);
-                    // send the view projection matrix to the shader
-                    material->shader->set("VP", VP);
-                    // send the model matrix to the shader
-                    material->shader->set("M", command.localToWorld);
-                    // send the model view matrix to the shader
-                    material->shader->set("M_IT", glm::transpose(glm::inverse(command.localToWorld)));
-                    // fragment shader
-                    // sky light color data
-                    // send the sky light color data to the shader
-                    material->shader->set("Sky.top", glm::vec3(0.0f, 1.0f, 0.5f));
-                    material->shader->set("Sky.middle", glm::vec3(0.3f, 0.3f, 0.3f));
-                    material->shader->set("Sky.bottom", glm::vec3(0.1f, 0.1f, 0.1f));
-                    //  send the light count
-                    material->shader->set("light_count", (GLint)lightComponents.size());
-                    // loop over the light components and send the light data to the shader
-                    for (auto i = 0; i < (int)lightComponents.size(); i++)
-                    {
-                        material->shader->set("lights[" + std::to_string(i) + "].type", (GLint)lightComponents[i]->LightType);
-                        // in case of directional light we need to send the direction of the light only
-                        if (lightComponents[i]->LightType == LightType::DIRECTIONAL)
-                        {
-                            // calculate the light direction in world space from entity component
-                            // glm::vec3 directional_direction = glm::normalize(lightComponents[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(lightComponents[i]->getOwner()->localTransform.rotation ,0));
-                            glm::vec3 directional_direction = glm::normalize(lightComponents[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(lightComponents[i]->direction, 0));
-                            material->shader->set("lights[" + std::to_string(i) + "].direction", directional_direction);
-                        }
-                        // in case of point light we need to send the position of the light only
-                        else if (lightComponents[i]->LightType == LightType::POINT)
-                        {
-                            glm::vec3 position = glm::vec3(lightComponents[i]->getOwner()->getLocalToWorldMatrix()[3]);
-                            material->shader->set("lights[" + std::to_string(i) + "].position", position);
-                        }
-                        // in case of spot light we need to send the position and direction of the light
-                        else if (lightComponents[i]->LightType == LightType::SPOT)
-                        {
-                            // glm::vec3 directional_direction = glm::normalize(lightComponents[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(lightComponents[i]->getOwner()->localTransform.rotation ,0));
-                            glm::vec3 directional_direction = glm::normalize(lightComponents[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(lightComponents[i]->direction, 0));
-                            // cout the direction of the light
-                            // std::cout << "directional_direction: " << directional_direction.x << " " << directional_direction.y << " " << directional_direction.z << std::endl;
-                            // we multiply local to world matrix by (0,0,0,1) to get the vec3 and drop the w component
-                            glm::vec3 position = glm::vec3(lightComponents[i]->getOwner()->getLocalToWorldMatrix()[3]);
-                            material->shader->set("lights[" + std::to_string(i) + "].position", position);
-                            material->shader->set("lights[" + std::to_string(i) + "].direction", directional_direction);
-                            material->shader->set("lights[" + std::to_string(i) + "].cone_angles", lightComponents[i]->cone_angles);
-                        }
-                        // material->shader->set("lights[" + std::to_string(i) + "].color", lightComponents[i]->color);
-                        material->shader->set("lights[" + std::to_string(i) + "].attenuation", lightComponents[i]->attenuation);
-                        material->shader->set("lights[" + std::to_string(i) + "].diffuse", lightComponents[i]->diffuse);
-                        material->shader->set("lights[" + std::to_string(i) + "].specular", lightComponents[i]->specular);
-                    }
-                }
+                drawCommand(command, VP);
             }
-            else
-            {
-                glm::mat4 modelViewProjection = VP * command.localToWorld;
-                command.material->setup();
-                command.material->shader->set("transform", modelViewProjection);
-            }
-
-            command.mesh->draw();
         }
 
         // If there is a postprocess material, apply postprocessing
         if (postprocessMaterial)
         {
+            OUR_PROFILE_GPU_SCOPE("Postprocess");
             // TODO: (Req 11) Return to the default framebuffer
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-
-            ShaderProgram *postprocessShader = new ShaderProgram();
-            // attach the vertex shader
-            postprocessShader->attach("assets/shaders/fullscreen.vert", GL_VERTEX_SHADER);
-
-            // attach the fragment shader based on the effect type (fish eye or blur or power up or radial blur or vignette)
-            if (effectOne)
-                postprocessShader->attach("assets/shaders/postprocess/grayscale.frag", GL_FRAGMENT_SHADER);
-            else if (effectTwo)
-                postprocessShader->attach("assets/shaders/postprocess/radial-blur.frag", GL_FRAGMENT_SHADER);
-            else if (effectThree)
-                postprocessShader->attach("assets/shaders/postprocess/speed.frag", GL_FRAGMENT_SHADER);
-            else
-                postprocessShader->attach("assets/shaders/postprocess/vignette.frag", GL_FRAGMENT_SHADER);
-
-            // link the shader program
-            postprocessShader->link();
-
-            // create a postprocess material for the postprocess shader
-            postprocessMaterial->shader = postprocessShader;
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLStateCache::getDefaultFramebuffer());
 
             // TODO: (Req 11) Setup the postprocess material and draw the fullscreen triangle
-            glBindVertexArray(postProcessVertexArray);
-            postprocessMaterial->setup();
-            glDrawArrays(GL_TRIANGLES, 0, 3);
+            // Pick the chain based on the effect type (death, star or speed), otherwise apply the default chain
+            // No shader is compiled here since all the effects were compiled in "initialize"
+            PostprocessHandle chain = effectOne ? deathChain : effectTwo ? starChain : effectThree ? speedChain : defaultChain;
+            applyPostprocessChain(chain);
         }
     }
 
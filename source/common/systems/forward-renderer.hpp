@@ -5,10 +5,16 @@
 #include "../components/mesh-renderer.hpp"
 #include "../asset-loader.hpp"
 #include "../components/light.hpp"
+#include "frustum-culling.hpp"
+#include "light-clusters.hpp"
+#include "shadow-maps.hpp"
 
 #include <glad/gl.h>
 #include <vector>
+#include <string>
+#include <unordered_map>
 #include <algorithm>
+#include <cstdint>
 
 namespace our
 {
@@ -21,8 +27,40 @@ namespace our
         glm::vec3 center;
         Mesh* mesh;
         Material* material;
+        std::uint64_t sortKey; // Only used for opaque commands (see "ForwardRenderer::getOpaqueSortKey")
     };
 
+    // The number of mesh renderers that passed (visible) or failed (culled) the frustum culling in a frame
+    struct CullingStats {
+        size_t visible = 0, culled = 0;
+    };
+
+    // The binding points of the uniform blocks shared by all the lighted shaders
+    constexpr GLuint CAMERA_BLOCK_BINDING = 0;
+    constexpr GLuint LIGHTING_BLOCK_BINDING = 1;
+
+    // These structures mirror the std140 layout of the uniform blocks in "assets/shaders/lighted.vert/.frag"
+    // In std140, every vec3 is aligned to 16 bytes, and every struct (and array element) is padded to a multiple of 16 bytes
+    struct CameraBlock {
+        glm::mat4 VP;
+        glm::vec3 eye; float pad0;
+    };
+
+    // The lights themselves are not in the block, they are in the buffer textures of the light clusters (see "LightClusters")
+    struct LightingBlock {
+        glm::vec3 skyTop; float pad0;
+        glm::vec3 skyMiddle; float pad1;
+        glm::vec3 skyBottom; float pad2;
+        glm::ivec3 clusterCount; float clusterDepthScale;
+        glm::vec2 clusterTileSize; float clusterDepthBias; float pad3;
+        glm::vec4 viewDepthPlane; // dot(viewDepthPlane, vec4(world, 1)) is the distance of a world point along the camera forward direction
+    };
+    static_assert(sizeof(LightingBlock) == 96, "LightingBlock must match the std140 layout of the Lighting block");
+
+    // A handle to a post processing effect or a chain of effects that was compiled during "ForwardRenderer::initialize"
+    // The handle is just an index into the renderer's effect (or chain) list. A negative handle means "not found".
+    using PostprocessHandle = int;
+
     // A forward renderer is a renderer that draw the object final color directly to the framebuffer
     // In other words, the fragment shader in the material should output the color that we should see on the screen
     // This is different from more complex renderers that could draw intermediate data to a framebuffer before computing the final color
@@ -34,6 +72,30 @@ namespace our
         // We define them here (instead of being local to the "render" function) as an optimization to prevent reallocating them every frame
         std::vector<RenderCommand> opaqueCommands;
         std::vector<RenderCommand> transparentCommands;
+        // The opaque commands are grouped by (mesh, material). A group with more than one command whose material
+        // has an instanced shader is drawn with a single instanced draw call
+        struct RenderBatch {
+            size_t first, count; // The range of the batch commands in "opaqueCommands"
+            bool instanced; // If true, the batch instance data starts at "instanceOffset" in the instance buffer
+            GLintptr instanceOffset;
+            bool depthPrepass; // If true, the batch depth is drawn in the pre-pass and its color pass only shades the visible pixels
+        };
+        std::vector<RenderBatch> opaqueBatches;
+        // The mesh renderers of the frame and their bounding spheres (reused every frame to avoid reallocations)
+        std::vector<MeshRendererComponent*> cullCandidates;
+        SphereCuller sphereCuller;
+        bool frustumCulling = true;
+        // If enabled, the depth of the opaque lighted objects is drawn first with a position-only shader, then their color pass
+        // uses GL_EQUAL without depth writes, so the expensive lighted shader runs once per visible pixel (no overdraw)
+        bool depthPrepass = false;
+        ShaderProgram *depthShader = nullptr, *depthInstancedShader = nullptr;
+        UniformId depthShaderM;
+        CullingStats cullingStats; // The result of the culling in the last frame
+        // The instance data of all the instanced batches of the frame (uploaded once per frame to the instance buffer)
+        std::vector<InstanceData> instanceData;
+        GLuint instanceBuffer = 0;
+        // The instance buffer is never shrunk, since the meshes' vertex arrays keep pointing into it
+        GLsizeiptr instanceBufferCapacity = 0;
         // Objects used for rendering a skybox
         Mesh* skySphere;
         TexturedMaterial* skyMaterial;
@@ -41,7 +103,65 @@ namespace our
         GLuint postprocessFrameBuffer, postProcessVertexArray;
         Texture2D *colorTarget, *depthTarget;
         TexturedMaterial* postprocessMaterial;
-        std::vector<LightComponent *> lightComponents; //light components for max number of lights, is a vector of light components
+        // Every post processing effect is compiled once in "initialize" and stored here (the handle is the index)
+        // The names map holds both the effect name (e.g. "vignette") and its fragment shader path
+        std::vector<ShaderProgram*> postprocessEffects;
+        std::unordered_map<std::string, PostprocessHandle> postprocessEffectNames;
+        // The defines with which each effect (by name) is compiled (e.g. the number of samples of the radial blur)
+        std::unordered_map<std::string, std::vector<std::string>> postprocessDefines;
+        // A chain is a list of effects applied one after the other (the handle is the index)
+        std::vector<std::vector<PostprocessHandle>> postprocessChains;
+        std::unordered_map<std::string, PostprocessHandle> postprocessChainNames;
+        // The chains picked every frame based on the effect flags (resolved once in "initialize")
+        PostprocessHandle defaultChain, deathChain, starChain, speedChain;
+        // A second color target used to ping-pong between the passes of a chain with more than one effect
+        GLuint pingPongFrameBuffer = 0;
+        Texture2D* pingPongTarget = nullptr;
+        std::vector<LightComponent *> lightComponents; // All the lights of the world in the current frame
+        // The lights are binned into view space clusters every frame, so each fragment only evaluates the lights that reach it
+        LightClusters lightClusters;
+        // The shadow maps of the lights that cast shadows and the first shadow view of every light (-1 for none)
+        ShadowMaps shadowMaps;
+        std::vector<int> lightShadowViews;
+        // The per-frame data of the lighted shaders. It is filled and uploaded to the uniform buffers once per frame
+        // so that each draw only needs to send its model matrices
+        CameraBlock cameraBlock;
+        LightingBlock lightingBlock;
+        GLuint cameraUniformBuffer = 0, lightingUniformBuffer = 0;
+
+        // The uniform handles needed to draw with a LightMaterial. They are looked up once per shader program
+        // (which is also when the shader's uniform blocks are connected to their binding points)
+        struct LightedUniforms {
+            UniformId M, M_IT;
+        };
+        std::unordered_map<ShaderProgram*, LightedUniforms> lightedUniforms;
+
+        // Returns the uniform handles of the given shader (looking them up if it is the first time we see this shader)
+        // It is also used for the instanced shaders, which only need their uniform blocks to be connected
+        const LightedUniforms& getLightedUniforms(ShaderProgram* shader);
+        // Sets up the given light material and sends the model matrices of the command
+        void setupLightedCommand(LightMaterial* material, const RenderCommand& command);
+        // Sets up the material of the given command and draws its mesh (without instancing)
+        // If "depthEqual" is true, only the pixels whose depth was written by the depth pre-pass are shaded
+        void drawCommand(const RenderCommand& command, const glm::mat4& VP, bool depthEqual = false);
+        // Returns true if the opaque objects drawn with the given material can be in the depth pre-pass
+        static bool usesDepthPrepass(const Material* material);
+        // Draws the depth of the opaque batches that use the depth pre-pass
+        void drawDepthPrepass();
+        // Returns the key by which the opaque commands are sorted. From the most to the least significant bits, it packs:
+        // the shader (10 bits), the pipeline state (12 bits), the main texture (10 bits), the mesh (10 bits) and the depth (22 bits)
+        // So the draws that share the expensive state are adjacent, and the draws that share everything go from front to back (for early depth rejection)
+        static std::uint64_t getOpaqueSortKey(const RenderCommand& command, const glm::vec3& eye, const glm::vec3& forward, float far);
+        // Sorts the opaque commands by their keys, groups them into batches and uploads the instance data of the instanced batches
+        void buildOpaqueBatches();
+
+        // Compiles the given fragment shader (with the fullscreen vertex shader) and registers it under the given name
+        // If an effect with the same name or path was already registered, its handle is returned instead
+        PostprocessHandle registerPostprocessEffect(const std::string& name, const std::string& path);
+        // Registers (or replaces) a named chain of effects and returns its handle
+        PostprocessHandle registerPostprocessChain(const std::string& name, const std::vector<PostprocessHandle>& effects);
+        // Draws the scene color target through all the effects of the given chain into the default framebuffer
+        void applyPostprocessChain(PostprocessHandle chain);
     public:
         // Initialize the renderer including the sky and the Postprocessing objects.
         // windowSize is the width & height of the window (in pixels).
@@ -49,7 +169,14 @@ namespace our
         // Clean up the renderer
         void destroy();
         // This function should be called every frame to draw the given world
-        void render(World* world);
+        // "interpolation" is how far the frame is between the last two fixed steps (see "Application::getInterpolationFactor")
+        void render(World* world, float interpolation = 1.0f);
+        // Returns the handle of the post processing chain with the given name or -1 if it doesn't exist
+        PostprocessHandle getPostprocessChain(const std::string& name) const;
+        // Returns the number of mesh renderers that were drawn and skipped by the frustum culling in the last frame
+        const CullingStats& getCullingStats() const { return cullingStats; }
+        // Flags used by the game to pick the post processing chain of the current frame
+        // effectOne: "death" chain, effectTwo: "star" chain, effectThree: "speed" chain, otherwise the "default" chain
         bool effectOne = false;
         bool effectTwo = false;
         bool effectThree = false;
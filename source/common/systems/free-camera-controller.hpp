@@ -4,9 +4,11 @@
 #include "../components/camera.hpp"
 #include "../components/free-camera-controller.hpp"
 #include "../components/movement.hpp"
+#include "../components/collider.hpp"
 
 #include "../application.hpp"
 #include "forward-renderer.hpp"
+#include "collision.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
@@ -36,12 +38,23 @@ namespace our
         int enteredStars = 1; 
         float lastTimeTakenPostPreprocessed = 0.0f;
         ForwardRenderer *renderer = nullptr; 
+        // The game entities are found by name using the world's name index (see "resolveEntities")
+        Entity * frog = nullptr;
+        Entity * woodenBox = nullptr;
         Entity * skull= nullptr;
-        std::vector<Entity *> stars;
+        bool entitiesResolved = false;
+        unsigned int resolvedWorldVersion = 0; // The world version when the entities were resolved
         bool repositionFrogCheck = false;
         bool validStar[2]={true, true};
         MovementComponent * skullMover = nullptr; 
         bool skullMoving = false;
+        // The collider layers of the things the frog interacts with (the frog's collider is tested against them)
+        std::uint32_t logLayer = ColliderComponent::getLayerMask("log");
+        std::uint32_t grassLayer = ColliderComponent::getLayerMask("mazeGrass");
+        std::uint32_t waterLayer = ColliderComponent::getLayerMask("water");
+        std::uint32_t carLayer = ColliderComponent::getLayerMask("car");
+        std::uint32_t starLayer = ColliderComponent::getLayerMask("star");
+        std::vector<Entity *> hits; // The result of the last collision query (kept to reuse its memory)
         
     public:
         // When a state enters, it should call this function and give it the pointer to the application
@@ -53,22 +66,23 @@ namespace our
             
         }
 
-        // This should be called every frame to update all entities containing a FreeCameraControllerComponent 
-        void update(World* world, float deltaTime,ForwardRenderer *renderer) {
-            // First of all, we search for an entity containing both a CameraComponent and a FreeCameraControllerComponent
-            // As soon as we find one, we break
-            this->renderer = renderer;
+        // Returns the first entity containing both a CameraComponent and a FreeCameraControllerComponent (or nullptr if there is none)
+        Entity* findControlledCamera(World* world, CameraComponent*& camera, FreeCameraControllerComponent*& controller) {
+            const auto& controlled = world->view<CameraComponent, FreeCameraControllerComponent>();
+            if(controlled.empty()) return nullptr;
+            camera = controlled.front()->getComponent<CameraComponent>();
+            controller = controlled.front()->getComponent<FreeCameraControllerComponent>();
+            return controlled.front();
+        }
+
+        // This should be called every frame (after the fixed steps) to rotate the camera with the mouse and zoom with the wheel
+        // The mouse delta is measured per frame, so looking around can't be part of the fixed step (some frames run no step at all)
+        void updateLook(World* world) {
             CameraComponent* camera = nullptr;
             FreeCameraControllerComponent *controller = nullptr;
-            for(auto entity : world->getEntities()){
-                camera = entity->getComponent<CameraComponent>();
-                controller = entity->getComponent<FreeCameraControllerComponent>();
-                if(camera && controller) break;
-            }
             // If there is no entity with both a CameraComponent and a FreeCameraControllerComponent, we can do nothing so we return
-            if(!(camera && controller)) return;
-            // Get the entity that we found via getOwner of camera (we could use controller->getOwner())
-            Entity* entity = camera->getOwner();
+            Entity* entity = findControlledCamera(world, camera, controller);
+            if(!entity) return;
 
             // If the left mouse button is pressed, we lock and hide the mouse. This common in First Person Games.
             if(app->getMouse().isPressed(GLFW_MOUSE_BUTTON_1) && !mouse_locked){
@@ -80,8 +94,7 @@ namespace our
                 mouse_locked = false;
             }
 
-            // We get a reference to the entity's position and rotation
-            glm::vec3& position = entity->localTransform.position;
+            // We get a reference to the entity's rotation
             glm::vec3& rotation = entity->localTransform.rotation;
 
             // If the left mouse button is pressed, we get the change in the mouse location
@@ -98,11 +111,27 @@ namespace our
             // This is not necessary, but whenever the rotation goes outside the 0 to 2*PI range, we wrap it back inside.
             // This could prevent floating point error if the player rotates in single direction for an extremely long time. 
             rotation.y = glm::wrapAngle(rotation.y);
+            // The rotation follows the mouse as soon as it moves, so it is not interpolated (only the position is)
+            entity->previousTransform.rotation = rotation;
 
             // We update the camera fov based on the mouse wheel scrolling amount
             float fov = camera->fovY + app->getMouse().getScrollOffset().y * controller->fovSensitivity;
             fov = glm::clamp(fov, glm::pi<float>() * 0.01f, glm::pi<float>() * 0.99f); // We keep the fov in the range 0.01*PI to 0.99*PI
             camera->fovY = fov;
+        }
+
+        // This should be called every fixed step to move the camera and run the game logic (the frog, the logs and the collisions)
+        // The collision system should be updated after the entities moved and before calling this function
+        void update(World* world, float deltaTime,ForwardRenderer *renderer, CollisionSystem *collisions) {
+            this->renderer = renderer;
+            CameraComponent* camera = nullptr;
+            FreeCameraControllerComponent *controller = nullptr;
+            // If there is no entity with both a CameraComponent and a FreeCameraControllerComponent, we can do nothing so we return
+            Entity* entity = findControlledCamera(world, camera, controller);
+            if(!entity) return;
+
+            // We get a reference to the entity's position
+            glm::vec3& position = entity->localTransform.position;
 
             // We get the camera model matrix (relative to its parent) to compute the front, up and right directions
             glm::mat4 matrix = entity->localTransform.toMat4();
@@ -126,58 +155,9 @@ namespace our
             if(app->getKeyboard().isPressed(GLFW_KEY_D)) position += right * (deltaTime * current_sensitivity.x);
             if(app->getKeyboard().isPressed(GLFW_KEY_A)) position -= right * (deltaTime * current_sensitivity.x);
 
-            Entity * frog = nullptr;
-            Entity *woodenBox = nullptr;
-            Entity *brickWall = nullptr;
-            Entity *pipe = nullptr;
-
-            std::vector<Entity *> logs;
-            std::vector<Entity *> cars;
-            std::vector<Entity *> water;
-            std::vector<Entity *> mazeGrass;
-
-            
-
-            for (auto entity : world->getEntities())
-            {
-                std::string name = entity->name;
-                 if (name == "frog")
-                {
-                    frog = entity;
-                }else if (name == "log")
-                {
-                    logs.push_back(entity);
-                }else if (name == "woodenBox")
-                {
-                    woodenBox = entity;
-                }else if (name == "brickWall")
-                {
-                    brickWall = entity;
-                }else if (name == "pipe")
-                {
-                    pipe = entity;
-                }else if (name == "floatingCar" || name == "floatingCarReversed")
-                {
-                    cars.push_back(entity);
-                }else if (name == "water")
-                {
-                    water.push_back(entity);
-                }else if (name == "mazeGrass")
-                {
-                    mazeGrass.push_back(entity);
-                }else if (name == "star")
-                {
-                    stars.push_back(entity);
-                }else if (name == "skull"){
-                    skull = entity;
-                    skullMover = entity->getComponent<MovementComponent>();
-                }
-                
-            }
-
-            
-
-            
+            // Look the game entities up again only if entities were added, removed or renamed since the last time
+            if (!entitiesResolved || world->getVersion() != resolvedWorldVersion)
+                resolveEntities(world);
 
             if (!frog)
                 return;
@@ -262,12 +242,10 @@ namespace our
 
             }
             frogAboveTrunk = false;
-            for (auto log : logs)
+            collisions->query(frog, logLayer, hits);
+            for (auto log : hits)
             {
-                if ((frog->localTransform.position.x < log->localTransform.position.x + log->localTransform.scale[0] &&
-                    frog->localTransform.position.x > log->localTransform.position.x - log->localTransform.scale[0] &&
-                    frog->localTransform.position.z < log->localTransform.position.z + log->localTransform.scale[2] &&
-                    frog->localTransform.position.z > log->localTransform.position.z - log->localTransform.scale[2]) && !skullMoving)
+                if (!skullMoving)
                 {
                     frogAboveTrunk = true;
                     MovementComponent * movement = log->getComponent<MovementComponent>();
@@ -285,25 +263,18 @@ namespace our
                 }
             }
             frogAboveGrass = false;
-            for (auto maze : mazeGrass)
+            collisions->query(frog, grassLayer, hits);
+            if (!hits.empty())
             {
-                if (frog->localTransform.position.x < maze->localTransform.position.x + maze->localTransform.scale[1] &&
-                    frog->localTransform.position.x > maze->localTransform.position.x - maze->localTransform.scale[1] &&
-
-                    frog->localTransform.position.z < maze->localTransform.position.z + maze->localTransform.scale[0] &&
-                    frog->localTransform.position.z > maze->localTransform.position.z - maze->localTransform.scale[0])
-                {
-                    frogAboveGrass = true;
-                }
+                frogAboveGrass = true;
             }
 
 
              if (!frogAboveGrass && !frogAboveTrunk && !skullMoving)
-                for (auto wat : water)
+             {
+                collisions->query(frog, waterLayer, hits);
+                for (size_t i = 0; i < hits.size(); i++)
                 {
-                    if (frog->localTransform.position.z  < (wat->localTransform.scale[1]) + wat->localTransform.position.z &&
-                    frog->localTransform.position.z   >  wat->localTransform.position.z - (wat->localTransform.scale[1]) ){
-
                         playAudio("splash.mp3");
                     
                      if(app->getLives() == 1)
@@ -313,28 +284,14 @@ namespace our
                     }else{
                         gameOver();
                     }
-                    
-                    }
                         
                 }
+             }
 
                 // check if a car hits the frog
-            for (auto car : cars)
+            collisions->query(frog, carLayer, hits);
+            for (size_t i = 0; i < hits.size(); i++)
             {
-                glm::mat4 carTransformationMatrix = car->getLocalToWorldMatrix();
-                glm::vec3 carPosition = glm::vec3(carTransformationMatrix[3]);
-                bool carRight= frog->localTransform.position.x < carPosition.x + 0.5f &&
-                    frog->localTransform.position.x > carPosition.x - 2.0f &&
-                    frog->localTransform.position.z < carPosition.z + 0.5f &&
-                    frog->localTransform.position.z > carPosition.z - 1.1f;
-
-
-                bool carLeft=frog->localTransform.position.x < carPosition.x + 2.0f &&
-                    frog->localTransform.position.x > carPosition.x - 0.5f &&
-                    frog->localTransform.position.z < carPosition.z + 0.75f &&
-                    frog->localTransform.position.z > carPosition.z - 0.85f;
-                if ((car->name =="floatingCar" && carRight )  || (car->name=="floatingCarReversed" && carLeft ))
-                {
                         if(app->getLives() == 1){
                             app->changeState("lose");
                             return;
@@ -343,8 +300,6 @@ namespace our
                             playAudio("car.mp3");
                             gameOver();
                         }
-                    
-                }
             }
 
             if (app->getTimeDiff() <= 0)
@@ -360,24 +315,23 @@ namespace our
             if(repositionFrogCheck){
                 repositionFrog(frog,position, world);
                 repositionFrogCheck = false;
+                // The frog, the skull and the camera are teleported, so they must not be drawn between their old and new places
+                frog->previousTransform = frog->localTransform;
+                skull->previousTransform = skull->localTransform;
+                entity->previousTransform = entity->localTransform;
             }
-            for (auto star : stars)
+            collisions->query(frog, starLayer, hits);
+            for (auto star : hits)
             {
-                if ((int(frog->localTransform.position.z) == int(star->localTransform.position.z)) &&
-                 (int(frog->localTransform.position.x) == int(star->localTransform.position.x)))
-                {
-                
                     world->markForRemoval(star); //? removing star after collision detection
-                    world->deleteMarkedEntities();
                     playAudio("stars.mp3");      //? playing audio at collision detection
                     renderer->effectTwo = true;   
                     //renderer->effectThree = true;
                     lastTimeTakenPostPreprocessed = (float)glfwGetTime();             
                     app->upgradeCheck();
-
-                    
-                }
             }
+            //? the collected stars are deleted after the loop (the collision system still refers to them until its next update)
+            world->deleteMarkedEntities();
             if (glfwGetTime() - lastTimeTakenPostPreprocessed >= 0.25f && renderer->effectTwo)
             {
                 renderer->effectTwo = false;
@@ -401,6 +355,17 @@ namespace our
 
         }
 
+        // Finds the game entities by name (using the world's name index) and remembers the world version
+        void resolveEntities(World *world)
+        {
+            frog = world->findByName("frog");
+            woodenBox = world->findByName("woodenBox");
+            skull = world->findByName("skull");
+            skullMover = skull ? skull->getComponent<MovementComponent>() : nullptr;
+            resolvedWorldVersion = world->getVersion();
+            entitiesResolved = true;
+        }
+
         void playAudio(std::string audioFileName, bool repeat = false, bool stopAll = false)
         {
             ISoundEngine *soundEngine = app->getSoundEngine();
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace our
+{
+
+    // The 6 planes of a view frustum in world space. Each plane is stored as (normal, distance) where
+    // dot(normal, point) + distance is positive for the points inside the frustum
+    struct Frustum {
+        glm::vec4 planes[6];
+
+        // Extracts the planes from a view-projection matrix (Gribb & Hartmann method)
+        static Frustum fromViewProjection(const glm::mat4& VP) {
+            // glm matrices are column major, so we read the rows manually
+            glm::vec4 rows[4];
+            for(int row = 0; row < 4; row++)
+                rows[row] = glm::vec4(VP[0][row], VP[1][row], VP[2][row], VP[3][row]);
+            Frustum frustum;
+            frustum.planes[0] = rows[3] + rows[0]; // Left
+            frustum.planes[1] = rows[3] - rows[0]; // Right
+            frustum.planes[2] = rows[3] + rows[1]; // Bottom
+            frustum.planes[3] = rows[3] - rows[1]; // Top
+            frustum.planes[4] = rows[3] + rows[2]; // Near
+            frustum.planes[5] = rows[3] - rows[2]; // Far
+            // Normalize the planes so that the plane equation gives the actual distance (needed to compare with a radius)
+            for(auto& plane : frustum.planes)
+                plane /= glm::length(glm::vec3(plane));
+            return frustum;
+        }
+    };
+
+    // A list of world space bounding spheres stored as a structure of arrays,
+    // so that the culling loop reads 4 consecutive values of each component (which the compiler can turn into SIMD operations)
+    class SphereCuller {
+        std::vector<float> x, y, z, radius;
+        std::vector<std::uint8_t> visible;
+    public:
+        static constexpr size_t BATCH_SIZE = 4;
+
+        void clear() {
+            x.clear(); y.clear(); z.clear(); radius.clear();
+        }
+
+        // Adds a sphere and returns its index
+        size_t add(const glm::vec3& center, float sphereRadius) {
+            x.push_back(center.x); y.push_back(center.y); z.push_back(center.z);
+            radius.push_back(sphereRadius);
+            return radius.size() - 1;
+        }
+
+        size_t size() const { return radius.size(); }
+
+        // Tests all the added spheres against the frustum. Afterwards, "isVisible" tells whether each sphere touches the frustum
+        // Returns the number of visible spheres
+        size_t cull(const Frustum& frustum) {
+            size_t count = radius.size();
+            // Pad the arrays to a whole number of batches (the padding results are ignored)
+            size_t padded = (count + BATCH_SIZE - 1) / BATCH_SIZE * BATCH_SIZE;
+            x.resize(padded, 0.0f); y.resize(padded, 0.0f); z.resize(padded, 0.0f); radius.resize(padded, 0.0f);
+            visible.assign(padded, 1);
+
+            for(size_t base = 0; base < padded; base += BATCH_SIZE){
+                std::uint8_t inside[BATCH_SIZE] = {1, 1, 1, 1};
+                for(const auto& plane : frustum.planes){
+                    // A sphere is outside if it is completely behind any of the planes
+                    for(size_t lane = 0; lane < BATCH_SIZE; lane++){
+                        size_t index = base + lane;
+                        float distance = plane.x * x[index] + plane.y * y[index] + plane.z * z[index] + plane.w;
+                        inside[lane] &= std::uint8_t(distance >= -radius[index]);
+                    }
+                }
+                for(size_t lane = 0; lane < BATCH_SIZE; lane++) visible[base + lane] = inside[lane];
+            }
+
+            x.resize(count); y.resize(count); z.resize(count); radius.resize(count);
+            visible.resize(count);
+            size_t visibleCount = 0;
+            for(auto flag : visible) visibleCount += flag;
+            return visibleCount;
+        }
+
+        bool isVisible(size_t index) const { return visible[index] != 0; }
+    };
+
+}
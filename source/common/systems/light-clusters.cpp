@@ -0,0 +1,196 @@
+#include "light-clusters.hpp"
+#include "../ecs/entity.hpp"
+#include "../gl-state-cache.hpp"
+#include "../profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+namespace our
+{
+
+    static void createStreamTexture(GLuint unit, GLenum format, GLuint& buffer, GLuint& texture)
+    {
+        glGenBuffers(1, &buffer);
+        glGenTextures(1, &texture);
+        GLStateCache::activeTexture(unit);
+        GLStateCache::bindTextureBuffer(texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    }
+
+    void LightClusters::initialize(glm::ivec3 count)
+    {
+        this->count = glm::max(count, glm::ivec3(1));
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        createStreamTexture(LIGHT_DATA_UNIT, GL_RGBA32F, lightData.buffer, lightData.texture);
+        createStreamTexture(CLUSTER_GRID_UNIT, GL_RG32UI, grid.buffer, grid.texture);
+        createStreamTexture(CLUSTER_LIGHTS_UNIT, GL_R16UI, indices.buffer, indices.texture);
+        // Give every buffer some storage so that the textures are valid before the first update
+        glm::vec4 emptyLight[LIGHT_DATA_TEXELS] = {};
+        upload(lightData, emptyLight, sizeof(emptyLight));
+        clusterRanges.assign(size_t(this->count.x) * this->count.y * this->count.z, glm::uvec2(0));
+        upload(grid, clusterRanges.data(), (GLsizeiptr)(clusterRanges.size() * sizeof(glm::uvec2)));
+        std::uint16_t emptyIndex = 0;
+        upload(indices, &emptyIndex, sizeof(emptyIndex));
+        overflowReported = false;
+    }
+
+    void LightClusters::destroy()
+    {
+        for (StreamTexture *target : {&lightData, &grid, &indices})
+        {
+            if (target->texture == 0)
+                continue;
+            GLStateCache::forgetTexture(target->texture);
+            glDeleteTextures(1, &target->texture);
+            glDeleteBuffers(1, &target->buffer);
+            *target = StreamTexture{};
+        }
+    }
+
+    void LightClusters::upload(StreamTexture &target, const void *data, GLsizeiptr size)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, target.buffer);
+        // Grow with some slack so that a few more lights don't reallocate the buffer every frame
+        if (size > target.capacity)
+            target.capacity = size + size / 2;
+        // Orphan the old storage so that we don't wait for the previous frame's draws to finish reading it
+        glBufferData(GL_TEXTURE_BUFFER, target.capacity, nullptr, GL_STREAM_DRAW);
+        if (size > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void LightClusters::addLightSpans(std::uint16_t light, const glm::vec3 &center, float range, const glm::mat4 &projection, float near, float far)
+    {
+        if (!std::isfinite(range))
+        {
+            spans.push_back({light, 0, std::uint16_t(count.x - 1), 0, std::uint16_t(count.y - 1), 0, std::uint16_t(count.z - 1)});
+            return;
+        }
+        // The view space looks along -z, so the depth is -z
+        float depth = -center.z;
+        float minDepth = std::max(depth - range, near), maxDepth = std::min(depth + range, far);
+        if (minDepth > maxDepth)
+            return;
+        auto getSlice = [&](float sliceDepth)
+        { return std::clamp((int)std::floor(std::log(sliceDepth) * depthScale + depthBias), 0, count.z - 1); };
+        auto getSliceStart = [&](int slice)
+        { return std::exp((float(slice) - depthBias) / depthScale); };
+
+        int lastSlice = getSlice(maxDepth);
+        for (int slice = getSlice(minDepth); slice <= lastSlice; slice++)
+        {
+            float sliceNear = std::max(getSliceStart(slice), minDepth), sliceFar = std::min(getSliceStart(slice + 1), maxDepth);
+            // The light sphere is cut by the slice, so its cross section is smaller than the range unless its center is inside the slice
+            float distance = depth < sliceNear ? sliceNear - depth : depth > sliceFar ? depth - sliceFar : 0.0f;
+            float radius = std::sqrt(std::max(range * range - distance * distance, 0.0f));
+            // The screen rectangle of the slice part of the sphere is bounded by the projected corners of its bounding box
+            glm::vec2 low(std::numeric_limits<float>::max()), high(std::numeric_limits<float>::lowest());
+            for (int corner = 0; corner < 8; corner++)
+            {
+                glm::vec4 point(center.x + ((corner & 1) ? radius : -radius), center.y + ((corner & 2) ? radius : -radius),
+                                (corner & 4) ? -sliceFar : -sliceNear, 1.0f);
+                glm::vec4 clip = projection * point;
+                glm::vec2 ndc = glm::vec2(clip) / clip.w;
+                low = glm::min(low, ndc);
+                high = glm::max(high, ndc);
+            }
+            if (high.x < -1.0f || high.y < -1.0f || low.x > 1.0f || low.y > 1.0f)
+                continue;
+            glm::ivec2 first = glm::clamp(glm::ivec2(glm::floor((low * 0.5f + 0.5f) * glm::vec2(count))), glm::ivec2(0), glm::ivec2(count) - 1);
+            glm::ivec2 last = glm::clamp(glm::ivec2(glm::floor((high * 0.5f + 0.5f) * glm::vec2(count))), glm::ivec2(0), glm::ivec2(count) - 1);
+            spans.push_back({light, std::uint16_t(first.x), std::uint16_t(last.x), std::uint16_t(first.y), std::uint16_t(last.y),
+                             std::uint16_t(slice), std::uint16_t(slice)});
+        }
+    }
+
+    void LightClusters::update(const std::vector<LightComponent *> &lights, const std::vector<int> &shadowViews, const glm::mat4 &view,
+                               const glm::mat4 &projection, float near, float far, glm::ivec2 viewportSize)
+    {
+        OUR_PROFILE_SCOPE("Light clustering");
+        tileSize = glm::vec2(viewportSize) / glm::vec2(count);
+        // The slices are spaced exponentially: slice k starts at near * (far / near)^(k / slices)
+        float logRatio = std::log(far / near);
+        depthScale = float(count.z) / logRatio;
+        depthBias = -float(count.z) * std::log(near) / logRatio;
+
+        // The indices are 16 bits and every light must fit in the light data texture
+        size_t lightCount = std::min({lights.size(), size_t(maxTexels / LIGHT_DATA_TEXELS), size_t(std::numeric_limits<std::uint16_t>::max()) + 1});
+        lightTexels.clear();
+        spans.clear();
+        for (size_t index = 0; index < lightCount; index++)
+        {
+            LightComponent *light = lights[index];
+            const glm::mat4 &localToWorld = light->getOwner()->getRenderMatrix();
+            glm::vec3 position = glm::vec3(localToWorld[3]);
+            glm::vec3 direction = glm::normalize(glm::vec3(localToWorld * glm::vec4(light->direction, 0)));
+            lightTexels.push_back(glm::vec4(position, float(light->LightType)));
+            lightTexels.push_back(glm::vec4(direction, light->cone_angles.x));
+            lightTexels.push_back(glm::vec4(light->diffuse, light->cone_angles.y));
+            lightTexels.push_back(glm::vec4(light->specular, float(shadowViews[index])));
+            lightTexels.push_back(glm::vec4(light->attenuation, 0.0f));
+            float range = light->getRange();
+            if (range > 0.0f)
+                addLightSpans(std::uint16_t(index), glm::vec3(view * glm::vec4(position, 1.0f)), range, projection, near, far);
+        }
+
+        // Count the lights of every cluster, then turn the counts into the offsets of the lists in the index buffer
+        auto forEachCluster = [&](const LightSpan &span, auto &&function)
+        {
+            for (int z = span.z0; z <= span.z1; z++)
+                for (int y = span.y0; y <= span.y1; y++)
+                    for (int x = span.x0; x <= span.x1; x++)
+                        function((size_t(z) * count.y + y) * count.x + x);
+        };
+        std::fill(clusterRanges.begin(), clusterRanges.end(), glm::uvec2(0));
+        for (const LightSpan &span : spans)
+            forEachCluster(span, [&](size_t cluster)
+                           { clusterRanges[cluster].y++; });
+        std::uint32_t offset = 0, limit = std::uint32_t(maxTexels);
+        bool overflow = false;
+        for (glm::uvec2 &range : clusterRanges)
+        {
+            // If the lists don't fit in the index texture, the last clusters lose some of their lights
+            if (range.y > limit - offset)
+            {
+                range.y = limit - offset;
+                overflow = true;
+            }
+            range.x = offset;
+            offset += range.y;
+        }
+        if (overflow && !overflowReported)
+        {
+            std::cerr << "The cluster light lists don't fit in a texture buffer, some lights are skipped (use less clusters or smaller light ranges)" << std::endl;
+            overflowReported = true;
+        }
+        lastIndexCount = offset;
+
+        // The spans are in the order of the lights, so every list is sorted by light index
+        lightIndices.resize(std::max<size_t>(offset, 1));
+        clusterCursors.assign(clusterRanges.size(), 0);
+        for (const LightSpan &span : spans)
+            forEachCluster(span, [&](size_t cluster)
+                           {
+                if (clusterCursors[cluster] < clusterRanges[cluster].y)
+                    lightIndices[clusterRanges[cluster].x + clusterCursors[cluster]++] = span.light; });
+
+        upload(lightData, lightTexels.data(), (GLsizeiptr)(lightTexels.size() * sizeof(glm::vec4)));
+        upload(grid, clusterRanges.data(), (GLsizeiptr)(clusterRanges.size() * sizeof(glm::uvec2)));
+        upload(indices, lightIndices.data(), (GLsizeiptr)(offset * sizeof(std::uint16_t)));
+    }
+
+    void LightClusters::bind() const
+    {
+        GLStateCache::activeTexture(LIGHT_DATA_UNIT);
+        GLStateCache::bindTextureBuffer(lightData.texture);
+        GLStateCache::activeTexture(CLUSTER_GRID_UNIT);
+        GLStateCache::bindTextureBuffer(grid.texture);
+        GLStateCache::activeTexture(CLUSTER_LIGHTS_UNIT);
+        GLStateCache::bindTextureBuffer(indices.texture);
+    }
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../components/light.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+namespace our
+{
+
+    // The texture units to which the cluster buffers are bound while drawing (the materials use the units below them)
+    // The lighted shaders read them through the samplers "light_data", "cluster_grid" and "cluster_lights"
+    constexpr GLuint LIGHT_DATA_UNIT = 13;
+    constexpr GLuint CLUSTER_GRID_UNIT = 14;
+    constexpr GLuint CLUSTER_LIGHTS_UNIT = 15;
+
+    // The number of RGBA32F texels used to store one light in the light data buffer (see "assets/shaders/lighted.frag")
+    constexpr int LIGHT_DATA_TEXELS = 5;
+
+    // The view frustum is split into a grid of clusters (screen tiles x depth slices, the slices are thinner near the camera)
+    // Every frame, each light is binned (on the CPU) into the clusters that its range overlaps, then three buffer textures are uploaded:
+    // - The light data: LIGHT_DATA_TEXELS texels per light.
+    // - The grid: the (offset, count) of each cluster's list in the index buffer.
+    // - The indices: the lights of every cluster one list after the other.
+    // So the fragment shader only evaluates the lights of its cluster instead of every light in the scene.
+    // The lights without a range (directional lights) are in every cluster.
+    class LightClusters {
+        glm::ivec3 count = {16, 9, 24}; // The number of tiles along x & y and the number of depth slices
+        glm::vec2 tileSize = {1, 1};    // The size of a tile in pixels
+        float depthScale = 1, depthBias = 0; // slice = log(depth) * depthScale + depthBias
+
+        // The buffer textures (and their buffers, which are orphaned and refilled every frame)
+        struct StreamTexture {
+            GLuint buffer = 0, texture = 0;
+            GLsizeiptr capacity = 0;
+        };
+        StreamTexture lightData, grid, indices;
+        GLint maxTexels = 65536; // GL_MAX_TEXTURE_BUFFER_SIZE (65536 is the minimum guaranteed by OpenGL 3.3)
+
+        // The clusters covered by a light in one depth slice range (inclusive bounds)
+        struct LightSpan {
+            std::uint16_t light;
+            std::uint16_t x0, x1, y0, y1, z0, z1;
+        };
+        std::vector<glm::vec4> lightTexels;
+        std::vector<LightSpan> spans;
+        std::vector<glm::uvec2> clusterRanges;
+        std::vector<std::uint32_t> clusterCursors;
+        std::vector<std::uint16_t> lightIndices;
+        size_t lastIndexCount = 0;
+        bool overflowReported = false;
+
+        // Adds the spans of a light with the given view space center and range
+        void addLightSpans(std::uint16_t light, const glm::vec3& center, float range, const glm::mat4& projection, float near, float far);
+        // Grows (if needed), orphans and refills the buffer of the given texture
+        static void upload(StreamTexture& target, const void* data, GLsizeiptr size);
+
+    public:
+        // Creates the buffer textures for the given grid size
+        void initialize(glm::ivec3 count);
+        void destroy();
+
+        // Bins the given lights into the clusters of the given camera then uploads the buffers
+        // "shadowViews" holds the first shadow view of every light or -1 (see "ShadowMaps::update")
+        void update(const std::vector<LightComponent*>& lights, const std::vector<int>& shadowViews, const glm::mat4& view,
+                    const glm::mat4& projection, float near, float far, glm::ivec2 viewportSize);
+        // Binds the buffer textures to their texture units
+        void bind() const;
+
+        glm::ivec3 getCount() const { return count; }
+        glm::vec2 getTileSize() const { return tileSize; }
+        float getDepthScale() const { return depthScale; }
+        float getDepthBias() const { return depthBias; }
+        // The total length of the cluster light lists in the last frame (the average per cluster shows how well the lights are binned)
+        size_t getIndexCount() const { return lastIndexCount; }
+    };
+
+}
@@ -17,11 +17,11 @@ namespace our
     class MovementSystem {
     public:
 
-        // This should be called every frame to update all entities containing a MovementComponent. 
+        // This should be called every fixed step to update all entities containing a MovementComponent. 
         void update(World* world, float deltaTime) {
-            // For each entity in the world
-            for(auto entity : world->getEntities()){
-                // Get the movement component if it exists
+            // For each entity in the world that has a movement component
+            for(auto entity : world->view<MovementComponent>()){
+                // Get the movement component
                 MovementComponent* movement = entity->getComponent<MovementComponent>();
                 if(movement){
 
@@ -36,6 +36,8 @@ namespace our
                             entity->localTransform.position += deltaTime * movement->linearVelocity;                          
                         }else{
                             entity->localTransform.position[0] = -11.0f;
+                            // The entity wrapped around to the other side, so it is not drawn sliding across the level
+                            entity->previousTransform = entity->localTransform;
                         }
                         
                     }
@@ -47,6 +49,7 @@ namespace our
                             entity->localTransform.position -= deltaTime * movement->linearVelocity;
                         }else{
                             entity->localTransform.position[0] = 11.0f;
+                            entity->previousTransform = entity->localTransform;
                         }
                     }
 
@@ -58,6 +61,7 @@ namespace our
                             entity->localTransform.position += deltaTime * movement->linearVelocity;
                         }else{
                             entity->localTransform.position[0] = -11.0f;
+                            entity->previousTransform = entity->localTransform;
                         }
                     }
 
@@ -69,6 +73,7 @@ namespace our
                             entity->localTransform.position -= deltaTime * movement->linearVelocity;
                         }else{
                             entity->localTransform.position[0] = 11.0f;
+                            entity->previousTransform = entity->localTransform;
                         }
                     }
                 }
@@ -0,0 +1,365 @@
+#include "shadow-maps.hpp"
+#include "../components/mesh-renderer.hpp"
+#include "../material/material.hpp"
+#include "../asset-cache.hpp"
+#include "../gl-state-cache.hpp"
+#include "../profiler.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace our
+{
+
+    // Creates a depth texture of the given size and a framebuffer that draws into it
+    static void createDepthTarget(glm::ivec2 size, bool compare, GLuint &texture, GLuint &framebuffer)
+    {
+        glGenTextures(1, &texture);
+        GLStateCache::activeTexture(SHADOW_ATLAS_UNIT);
+        GLStateCache::bindTexture2D(texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size.x, size.y, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (compare)
+        {
+            // With the comparison on, a linear filter returns the fraction of the 4 nearest texels that are lit (2x2 PCF for free)
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        else
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "The shadow atlas framebuffer is incomplete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, GLStateCache::getDefaultFramebuffer());
+    }
+
+    void ShadowMaps::initialize(const nlohmann::json &config)
+    {
+        // The block is always bound (the lighted shaders declare it), so it must exist even without shadows
+        block = ShadowsBlock{};
+        glGenBuffers(1, &uniformBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(ShadowsBlock), &block, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        enabled = config.is_object() && config.value("enabled", true);
+        if (!enabled)
+            return;
+        resolution = std::max(config.value("resolution", resolution), 16);
+        cascadeCount = std::clamp(config.value("cascades", cascadeCount), 1, MAX_SHADOW_CASCADES);
+        maxSpotLights = std::clamp(config.value("maxSpotLights", maxSpotLights), 0, MAX_SHADOW_VIEWS - cascadeCount);
+        distance = config.value("distance", distance);
+        splitLambda = std::clamp(config.value("splitLambda", splitLambda), 0.0f, 1.0f);
+        casterDistance = config.value("casterDistance", casterDistance);
+        directionThreshold = std::cos(glm::radians(std::max(config.value("directionThreshold", 1.0f), 0.0f)));
+        block.bias = config.value("bias", 0.0005f);
+        block.normalBias = config.value("normalBias", 0.05f);
+
+        // The tiles are laid out in a grid that is as square as possible
+        int tileCount = cascadeCount + maxSpotLights;
+        columns = (int)std::ceil(std::sqrt((float)tileCount));
+        rows = (tileCount + columns - 1) / columns;
+        GLint maxSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        resolution = std::min(resolution, maxSize / std::max(columns, rows));
+        createDepthTarget(glm::ivec2(columns * resolution, rows * resolution), true, atlas, atlasFramebuffer);
+        // The static atlas is only created the first time a tile is cached (see "update")
+        tiles.assign(tileCount, TileState{});
+        hasCascadeDirection = false;
+
+        shader = acquireShader("assets/shaders/shadow.vert", "assets/shaders/depth-only.frag");
+        shaderVP = shader->getUniformId("VP");
+        shaderM = shader->getUniformId("M");
+    }
+
+    void ShadowMaps::destroy()
+    {
+        glDeleteBuffers(1, &uniformBuffer);
+        uniformBuffer = 0;
+        if (!enabled)
+            return;
+        for (GLuint *texture : {&atlas, &staticAtlas})
+        {
+            if (*texture == 0)
+                continue;
+            GLStateCache::forgetTexture(*texture);
+            glDeleteTextures(1, texture);
+            *texture = 0;
+        }
+        glDeleteFramebuffers(1, &atlasFramebuffer);
+        if (staticFramebuffer)
+            glDeleteFramebuffers(1, &staticFramebuffer);
+        atlasFramebuffer = staticFramebuffer = 0;
+        tiles.clear();
+        AssetCache::release(shader);
+        shader = nullptr;
+        casterStates.clear();
+        enabled = false;
+    }
+
+    void ShadowMaps::invalidateTiles()
+    {
+        for (TileState &tile : tiles)
+            tile.staticValid = tile.liveStatic = false;
+    }
+
+    glm::vec4 ShadowMaps::getTile(int tile) const
+    {
+        glm::vec2 size(1.0f / float(columns), 1.0f / float(rows));
+        return glm::vec4(float(tile % columns) * size.x, float(tile / columns) * size.y, size);
+    }
+
+    glm::mat4 ShadowMaps::getCascadeMatrix(const glm::vec3 &lightDirection, const glm::mat4 &inverseView, const glm::mat4 &inverseProjection,
+                                           float nearDepth, float farDepth) const
+    {
+        // Find the view space corners of the slice: each frustum edge goes from a near plane corner to a far plane corner
+        // (interpolating along the edges works for both the perspective and the orthographic cameras)
+        glm::vec3 corners[8];
+        for (int edge = 0; edge < 4; edge++)
+        {
+            glm::vec2 ndc((edge & 1) ? 1.0f : -1.0f, (edge & 2) ? 1.0f : -1.0f);
+            glm::vec4 start = inverseProjection * glm::vec4(ndc, -1.0f, 1.0f);
+            glm::vec4 end = inverseProjection * glm::vec4(ndc, 1.0f, 1.0f);
+            glm::vec3 edgeStart = glm::vec3(start) / start.w, edgeEnd = glm::vec3(end) / end.w;
+            float startDepth = -edgeStart.z, length = -edgeEnd.z - startDepth;
+            corners[2 * edge] = glm::mix(edgeStart, edgeEnd, (nearDepth - startDepth) / length);
+            corners[2 * edge + 1] = glm::mix(edgeStart, edgeEnd, (farDepth - startDepth) / length);
+        }
+        // A bounding sphere (instead of a box) has the same size whatever the camera rotation is, so rotating the camera
+        // only moves the cascade. The radius is rounded up to avoid changing the matrix because of floating point noise.
+        glm::vec3 center(0.0f);
+        for (const glm::vec3 &corner : corners)
+            center += corner / 8.0f;
+        float radius = 0.0f;
+        for (const glm::vec3 &corner : corners)
+            radius = std::max(radius, glm::distance(center, corner));
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        glm::vec3 up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+        glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+        glm::vec3 lightCenter = glm::vec3(lightView * inverseView * glm::vec4(center, 1.0f));
+        // The center is snapped to a coarse grid (a whole number of texels) so that the cascade only moves after the camera moved
+        // a quarter of its radius. The margin around the sphere keeps it covered while the snapped center lags behind.
+        float halfExtent = radius * 1.25f;
+        float texel = 2.0f * halfExtent / float(resolution);
+        float step = std::max(std::round(radius * 0.25f / texel), 1.0f) * texel;
+        lightCenter = glm::floor(lightCenter / step + 0.5f) * step;
+        // The casters between the light and the sphere must be drawn too, so the near plane is pulled towards the light
+        glm::mat4 lightProjection = glm::ortho(lightCenter.x - halfExtent, lightCenter.x + halfExtent,
+                                               lightCenter.y - halfExtent, lightCenter.y + halfExtent,
+                                               -lightCenter.z - halfExtent - casterDistance, -lightCenter.z + halfExtent);
+        return lightProjection * lightView;
+    }
+
+    void ShadowMaps::drawCasters(const ShadowView &view, bool drawStatic, bool drawDynamic)
+    {
+        culler.cull(view.frustum);
+        shader->set(shaderVP, view.VP);
+        for (size_t index = 0; index < casters.size(); index++)
+        {
+            const Caster &caster = casters[index];
+            if (!(caster.dynamic ? drawDynamic : drawStatic) || !culler.isVisible(index))
+                continue;
+            shader->set(shaderM, caster.localToWorld);
+            caster.mesh->draw();
+        }
+    }
+
+    void ShadowMaps::update(World *world, const std::vector<LightComponent *> &lights, const glm::mat4 &view, const glm::mat4 &projection,
+                            float near, float far, std::vector<int> &shadowViews)
+    {
+        shadowViews.assign(lights.size(), -1);
+        views.clear();
+        block.cascadeCount = 0;
+        if (enabled)
+        {
+            // Pick the shadow views: the cascades of the first directional caster and a few spot lights
+            glm::mat4 inverseView = glm::inverse(view), inverseProjection = glm::inverse(projection);
+            bool hasCascades = false;
+            int spotLights = 0;
+            for (size_t index = 0; index < lights.size(); index++)
+            {
+                LightComponent *light = lights[index];
+                if (!light->castShadows)
+                    continue;
+                const glm::mat4 &localToWorld = light->getOwner()->getRenderMatrix();
+                glm::vec3 direction = glm::normalize(glm::vec3(localToWorld * glm::vec4(light->direction, 0.0f)));
+                if (light->LightType == LightType::DIRECTIONAL && !hasCascades)
+                {
+                    hasCascades = true;
+                    shadowViews[index] = (int)views.size();
+                    // The cascades keep the direction they were fitted to until the light turned by more than the threshold.
+                    // Otherwise a slowly rotating light (like the moon) would change their matrices and redraw them every frame.
+                    if (!hasCascadeDirection || glm::dot(direction, cascadeDirection) < directionThreshold)
+                    {
+                        cascadeDirection = direction;
+                        hasCascadeDirection = true;
+                    }
+                    // The splits mix a uniform and a logarithmic distribution of the depth ("practical split scheme")
+                    float shadowFar = std::min(far, distance), sliceNear = near;
+                    for (int cascade = 0; cascade < cascadeCount; cascade++)
+                    {
+                        float fraction = float(cascade + 1) / float(cascadeCount);
+                        float uniformSplit = near + (shadowFar - near) * fraction;
+                        float logSplit = near * std::pow(shadowFar / near, fraction);
+                        float split = glm::mix(uniformSplit, logSplit, splitLambda);
+                        glm::mat4 VP = getCascadeMatrix(cascadeDirection, inverseView, inverseProjection, sliceNear, split);
+                        views.push_back({VP, Frustum::fromViewProjection(VP)});
+                        block.cascadeSplits[cascade] = split;
+                        sliceNear = split;
+                    }
+                    block.cascadeCount = cascadeCount;
+                }
+                else if (light->LightType == LightType::SPOT && spotLights < maxSpotLights)
+                {
+                    // A light that doesn't reach past the near plane (e.g. a black light has no range) lights nothing to shadow
+                    float range = std::min(light->getRange(), distance);
+                    float shadowNear = std::max(range * 0.01f, 0.05f);
+                    if (!(range > shadowNear))
+                        continue;
+                    spotLights++;
+                    shadowViews[index] = (int)views.size();
+                    glm::vec3 position = glm::vec3(localToWorld[3]);
+                    glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+                    float fov = std::clamp(2.0f * light->cone_angles.y, 0.1f, 3.0f);
+                    glm::mat4 VP = glm::perspective(fov, 1.0f, shadowNear, range) *
+                                   glm::lookAt(position, position + direction, up);
+                    views.push_back({VP, Frustum::fromViewProjection(VP)});
+                }
+            }
+        }
+
+        for (size_t index = 0; index < views.size(); index++)
+        {
+            // Map the [-1, 1] clip space to the [0, 1] texture space of the tile
+            block.matrices[index] = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f)) * views[index].VP;
+            block.tiles[index] = getTile((int)index);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ShadowsBlock), &block);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        if (views.empty())
+            return;
+
+        // Collect the casters. An entity that is added or removed changes the world version, which resets the classification
+        if (world->getVersion() != staticWorldVersion)
+        {
+            staticWorldVersion = world->getVersion();
+            casterStates.clear();
+            invalidateTiles();
+        }
+        casters.clear();
+        culler.clear();
+        bool anyDynamic = false, anyStatic = false;
+        for (auto entity : world->view<MeshRendererComponent>())
+        {
+            auto meshRenderer = entity->getComponent<MeshRendererComponent>();
+            if (!meshRenderer->castShadows || meshRenderer->material->transparent)
+                continue;
+            unsigned int version = entity->getTransformVersion();
+            auto [state, inserted] = casterStates.try_emplace(entity, CasterState{version, false});
+            if (!inserted && state->second.transformVersion != version)
+            {
+                state->second.transformVersion = version;
+                // Its old depth is still in the static tiles, so they are redrawn without it
+                if (!state->second.dynamic)
+                    invalidateTiles();
+                state->second.dynamic = true;
+            }
+            anyDynamic |= state->second.dynamic;
+            anyStatic |= !state->second.dynamic;
+            const glm::mat4 &localToWorld = entity->getRenderMatrix();
+            float scale = glm::max(glm::length(glm::vec3(localToWorld[0])), glm::max(glm::length(glm::vec3(localToWorld[1])), glm::length(glm::vec3(localToWorld[2]))));
+            const MeshBounds &bounds = meshRenderer->mesh->getBounds();
+            culler.add(glm::vec3(localToWorld * glm::vec4(bounds.sphereCenter, 1.0f)), bounds.sphereRadius * scale);
+            casters.push_back({meshRenderer->mesh, localToWorld, state->second.dynamic});
+        }
+
+        // The casters are drawn from both sides (so thin or open meshes still cast shadows) with a slope scaled offset against acne
+        GLStateCache::setEnabled(GL_DEPTH_TEST, true);
+        GLStateCache::depthFunc(GL_LESS);
+        GLStateCache::depthMask(true);
+        GLStateCache::colorMask(glm::bvec4(false));
+        GLStateCache::setEnabled(GL_CULL_FACE, false);
+        GLStateCache::setEnabled(GL_BLEND, false);
+        GLStateCache::setEnabled(GL_POLYGON_OFFSET_FILL, true);
+        glPolygonOffset(1.5f, 2.0f);
+        shader->use();
+
+        // Each tile in use is brought up to date the cheapest way:
+        // - If it already holds the static casters of its view and there are no dynamic casters, it is kept as is.
+        // - If the dynamic casters are drawn over an unchanged view, the cached static depth is copied then only the dynamic casters are drawn.
+        // - Otherwise (the view just changed or there is nothing static to cache), all the casters are drawn straight into the tile.
+        //   The static depth is only cached once the view stays the same for a second frame, so a changing view never draws it twice.
+        glBindFramebuffer(GL_FRAMEBUFFER, atlasFramebuffer);
+        glEnable(GL_SCISSOR_TEST);
+        for (size_t index = 0; index < views.size(); index++)
+        {
+            TileState &tile = tiles[index];
+            const glm::mat4 &VP = views[index].VP;
+            bool stable = tile.previousMatrix == VP;
+            tile.previousMatrix = VP;
+            if (!anyDynamic && tile.liveStatic && tile.liveMatrix == VP)
+                continue;
+            glm::ivec2 corner(int(index) % columns * resolution, int(index) / columns * resolution);
+            glViewport(corner.x, corner.y, resolution, resolution);
+            glScissor(corner.x, corner.y, resolution, resolution);
+            if (anyDynamic && anyStatic && stable)
+            {
+                if (!tile.staticValid || tile.staticMatrix != VP)
+                {
+                    if (!staticAtlas)
+                        createDepthTarget(glm::ivec2(columns * resolution, rows * resolution), false, staticAtlas, staticFramebuffer);
+                    glBindFramebuffer(GL_FRAMEBUFFER, staticFramebuffer);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    drawCasters(views[index], true, false);
+                    tile.staticMatrix = VP;
+                    tile.staticValid = true;
+                }
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffer);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, atlasFramebuffer);
+                glBlitFramebuffer(corner.x, corner.y, corner.x + resolution, corner.y + resolution,
+                                  corner.x, corner.y, corner.x + resolution, corner.y + resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+                glBindFramebuffer(GL_FRAMEBUFFER, atlasFramebuffer);
+                drawCasters(views[index], false, true);
+            }
+            else
+            {
+                glClear(GL_DEPTH_BUFFER_BIT);
+                drawCasters(views[index], true, true);
+            }
+            tile.liveMatrix = VP;
+            tile.liveStatic = !anyDynamic;
+        }
+        glDisable(GL_SCISSOR_TEST);
+
+        GLStateCache::setEnabled(GL_POLYGON_OFFSET_FILL, false);
+        GLStateCache::colorMask(glm::bvec4(true));
+        glBindFramebuffer(GL_FRAMEBUFFER, GLStateCache::getDefaultFramebuffer());
+    }
+
+    void ShadowMaps::bind() const
+    {
+        glBindBufferBase(GL_UNIFORM_BUFFER, SHADOWS_BLOCK_BINDING, uniformBuffer);
+        if (atlas)
+        {
+            GLStateCache::activeTexture(SHADOW_ATLAS_UNIT);
+            GLStateCache::bindTexture2D(atlas);
+        }
+    }
+
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "../ecs/world.hpp"
+#include "../components/light.hpp"
+#include "../shader/shader.hpp"
+#include "../mesh/mesh.hpp"
+#include "frustum-culling.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <json/json.hpp>
+
+#include <cmath>
+#include <vector>
+#include <unordered_map>
+
+namespace our
+{
+
+    // The binding point of the "Shadows" uniform block and the texture unit of the shadow atlas (sampler "shadow_atlas")
+    constexpr GLuint SHADOWS_BLOCK_BINDING = 2;
+    constexpr GLuint SHADOW_ATLAS_UNIT = 12;
+    // These must match "assets/shaders/lighted.frag"
+    constexpr int MAX_SHADOW_VIEWS = 8;
+    constexpr int MAX_SHADOW_CASCADES = 4;
+
+    // This structure mirrors the std140 layout of the "Shadows" uniform block in "assets/shaders/lighted.frag"
+    struct ShadowsBlock {
+        glm::mat4 matrices[MAX_SHADOW_VIEWS]; // From world space to the [0, 1] texture space of each view's tile
+        glm::vec4 tiles[MAX_SHADOW_VIEWS];    // The tile of each view in the atlas: xy is its corner and zw is its size
+        glm::vec4 cascadeSplits;              // The view depth at which each cascade ends
+        GLint cascadeCount; float bias; float normalBias; float pad0;
+    };
+    static_assert(sizeof(ShadowsBlock) == 672, "ShadowsBlock must match the std140 layout of the Shadows block");
+
+    // The shadow maps of the lights with "castShadows" are drawn into the tiles of a single depth texture (the atlas):
+    // - The first directional shadow caster gets "cascades" tiles. Each one covers a slice of the camera view depth (the nearer, the smaller).
+    // - Up to "maxSpotLights" spot lights get one perspective tile each.
+    // Most casters never move, so a tile whose view didn't change is only redrawn when there are dynamic casters. In that case
+    // the depth of the static casters is cached in the tile of a second (static) atlas, which is copied back to the shadow atlas
+    // before the dynamic casters are drawn on top of it. A tile whose view just changed is drawn directly without the cache.
+    // The casters are classified automatically: a caster whose transform changes once becomes dynamic (until the world changes).
+    // The cascades are fitted to a bounding sphere and snapped in light space, so a moving camera rarely changes their matrices.
+    // They also keep their light direction until the light turned by more than "directionThreshold" degrees.
+    // It is configured by the "shadows" object of the renderer config:
+    //    "shadows": { "resolution": 1024, "cascades": 2, "distance": 30, "splitLambda": 0.75, "maxSpotLights": 2,
+    //                 "directionThreshold": 1, "casterDistance": 50, "bias": 0.0005, "normalBias": 0.05 }
+    // "resolution" is the size of a tile and "distance" is the view depth after which there are no directional shadows.
+    // The atlas has a tile for every cascade and spot light, so "maxSpotLights" should be 0 if no spot light casts shadows.
+    class ShadowMaps {
+        bool enabled = false;
+        int resolution = 1024, cascadeCount = 2, maxSpotLights = 2;
+        float distance = 30, splitLambda = 0.75f, casterDistance = 50;
+        float directionThreshold = std::cos(glm::radians(1.0f)); // The cosine of the angle the light must turn before the cascades follow it
+        glm::vec3 cascadeDirection = {0, -1, 0};
+        bool hasCascadeDirection = false;
+        int columns = 1, rows = 1; // The layout of the tiles in the atlas
+
+        // The shadow atlas is sampled by the lighted shaders, the static atlas only holds the depth of the static casters
+        GLuint atlas = 0, atlasFramebuffer = 0;
+        GLuint staticAtlas = 0, staticFramebuffer = 0;
+        GLuint uniformBuffer = 0;
+        ShaderProgram* shader = nullptr;
+        UniformId shaderVP, shaderM;
+        ShadowsBlock block;
+
+        // The views of the current frame (a view is drawn into the tile of the same index)
+        struct ShadowView {
+            glm::mat4 VP;
+            Frustum frustum;
+        };
+        std::vector<ShadowView> views;
+        // What each tile of the two atlases holds
+        struct TileState {
+            glm::mat4 previousMatrix = glm::mat4(0.0f); // The view of the last frame (to know if the view is stable)
+            glm::mat4 staticMatrix = glm::mat4(0.0f);   // The view with which the static atlas tile was drawn
+            glm::mat4 liveMatrix = glm::mat4(0.0f);     // The view with which the shadow atlas tile was drawn
+            bool staticValid = false;                   // True if the static atlas tile holds the current static casters
+            bool liveStatic = false;                    // True if the shadow atlas tile holds only the current static casters
+        };
+        std::vector<TileState> tiles;
+        unsigned int staticWorldVersion = 0;
+
+        // The shadow casters of the frame with their bounding spheres
+        struct Caster {
+            Mesh* mesh;
+            glm::mat4 localToWorld;
+            bool dynamic;
+        };
+        std::vector<Caster> casters;
+        SphereCuller culler;
+        // The transform version of every caster when it was last seen (to detect the casters that move)
+        struct CasterState {
+            unsigned int transformVersion;
+            bool dynamic;
+        };
+        std::unordered_map<const Entity*, CasterState> casterStates;
+
+        // Returns the view of a cascade covering the given view depth range of the camera
+        glm::mat4 getCascadeMatrix(const glm::vec3& lightDirection, const glm::mat4& inverseView, const glm::mat4& inverseProjection,
+                                   float nearDepth, float farDepth) const;
+        // Returns the [0, 1] rectangle of the given tile in the atlas
+        glm::vec4 getTile(int tile) const;
+        // Draws the static and/or dynamic casters visible from the given view into the bound framebuffer
+        void drawCasters(const ShadowView& view, bool drawStatic, bool drawDynamic);
+        // Forgets the static depth of all the tiles (after the set of static casters changed)
+        void invalidateTiles();
+
+    public:
+        // Creates the atlases if the config enables the shadows (the uniform buffer is always created)
+        void initialize(const nlohmann::json& config);
+        void destroy();
+
+        // Picks the shadow views of the lights, redraws the outdated static tiles, draws the dynamic casters and uploads the block
+        // "shadowViews" receives the first shadow view of every light (or -1 if the light has no shadow)
+        // It leaves the default framebuffer bound
+        void update(World* world, const std::vector<LightComponent*>& lights, const glm::mat4& view, const glm::mat4& projection,
+                    float near, float far, std::vector<int>& shadowViews);
+        // Binds the uniform block and the shadow atlas
+        void bind() const;
+
+        bool isEnabled() const { return enabled; }
+        size_t getViewCount() const { return views.size(); }
+    };
+
+}
@@ -0,0 +1,139 @@
+#include "block-compression.hpp"
+
+#include <glm/glm.hpp>
+#include <utility>
+
+// Packs a color into 5:6:5 bits
+static std::uint16_t packColor565(const glm::vec3& color) {
+    glm::vec3 clamped = glm::clamp(color, 0.0f, 255.0f);
+    std::uint16_t r = std::uint16_t((clamped.r * 31.0f + 127.5f) / 255.0f);
+    std::uint16_t g = std::uint16_t((clamped.g * 63.0f + 127.5f) / 255.0f);
+    std::uint16_t b = std::uint16_t((clamped.b * 31.0f + 127.5f) / 255.0f);
+    return std::uint16_t((r << 11) | (g << 5) | b);
+}
+
+// Expands a 5:6:5 color back to 8 bits per channel (the same way the hardware does it)
+static glm::vec3 unpackColor565(std::uint16_t packed) {
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    return glm::vec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+static void writeLittleEndian16(std::uint8_t* output, std::uint16_t value) {
+    output[0] = std::uint8_t(value & 0xFF);
+    output[1] = std::uint8_t(value >> 8);
+}
+
+// Encodes the colors of a block of 16 pixels into 8 bytes
+// The endpoints are picked at the extremes of the principal axis of the colors, then each pixel picks the nearest palette entry
+static void compressColorBlock(const glm::vec3 colors[16], std::uint8_t* output) {
+    glm::vec3 mean(0.0f);
+    for(int index = 0; index < 16; index++) mean += colors[index];
+    mean /= 16.0f;
+
+    // Find the principal axis of the colors using a few power iterations on their covariance matrix
+    glm::mat3 covariance(0.0f);
+    for(int index = 0; index < 16; index++){
+        glm::vec3 offset = colors[index] - mean;
+        covariance += glm::outerProduct(offset, offset);
+    }
+    glm::vec3 axis(1.0f, 1.0f, 1.0f);
+    for(int iteration = 0; iteration < 8; iteration++){
+        glm::vec3 next = covariance * axis;
+        float length = glm::length(next);
+        if(length < 1e-6f) break; // All the colors are (almost) the same
+        axis = next / length;
+    }
+
+    float minProjection = 0.0f, maxProjection = 0.0f;
+    for(int index = 0; index < 16; index++){
+        float projection = glm::dot(colors[index] - mean, axis);
+        minProjection = glm::min(minProjection, projection);
+        maxProjection = glm::max(maxProjection, projection);
+    }
+    std::uint16_t color0 = packColor565(mean + axis * maxProjection);
+    std::uint16_t color1 = packColor565(mean + axis * minProjection);
+    // The 4 color mode is selected by storing the larger endpoint first
+    if(color0 < color1) std::swap(color0, color1);
+
+    std::uint32_t indices = 0;
+    if(color0 != color1){
+        glm::vec3 palette[4];
+        palette[0] = unpackColor565(color0);
+        palette[1] = unpackColor565(color1);
+        palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+        palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+        for(int index = 0; index < 16; index++){
+            std::uint32_t best = 0;
+            float bestDistance = glm::dot(colors[index] - palette[0], colors[index] - palette[0]);
+            for(std::uint32_t entry = 1; entry < 4; entry++){
+                glm::vec3 difference = colors[index] - palette[entry];
+                float distance = glm::dot(difference, difference);
+                if(distance < bestDistance){ bestDistance = distance; best = entry; }
+            }
+            indices |= best << (2 * index);
+        }
+    }
+
+    writeLittleEndian16(output, color0);
+    writeLittleEndian16(output + 2, color1);
+    for(int byte = 0; byte < 4; byte++) output[4 + byte] = std::uint8_t(indices >> (8 * byte));
+}
+
+// Encodes the alphas of a block of 16 pixels into 8 bytes (the alpha part of a BC3 block)
+static void compressAlphaBlock(const std::uint8_t alphas[16], std::uint8_t* output) {
+    std::uint8_t alpha0 = 0, alpha1 = 255;
+    for(int index = 0; index < 16; index++){
+        alpha0 = glm::max(alpha0, alphas[index]);
+        alpha1 = glm::min(alpha1, alphas[index]);
+    }
+
+    std::uint64_t indices = 0;
+    if(alpha0 != alpha1){
+        // Since alpha0 > alpha1, the palette has the 2 endpoints followed by 6 interpolated values
+        int palette[8] = {alpha0, alpha1};
+        for(int entry = 1; entry <= 6; entry++)
+            palette[entry + 1] = ((7 - entry) * alpha0 + entry * alpha1) / 7;
+        for(int index = 0; index < 16; index++){
+            std::uint64_t best = 0;
+            int bestDistance = 256;
+            for(std::uint64_t entry = 0; entry < 8; entry++){
+                int distance = glm::abs(int(alphas[index]) - palette[entry]);
+                if(distance < bestDistance){ bestDistance = distance; best = entry; }
+            }
+            indices |= best << (3 * index);
+        }
+    }
+
+    output[0] = alpha0;
+    output[1] = alpha1;
+    for(int byte = 0; byte < 6; byte++) output[2 + byte] = std::uint8_t(indices >> (8 * byte));
+}
+
+size_t our::block_compression::getCompressedSize(glm::ivec2 size, bool withAlpha) {
+    size_t blocks = size_t((size.x + 3) / 4) * size_t((size.y + 3) / 4);
+    return blocks * (withAlpha ? 16 : 8);
+}
+
+void our::block_compression::compress(const std::uint8_t* pixels, glm::ivec2 size, bool withAlpha, std::uint8_t* output) {
+    for(int blockY = 0; blockY < size.y; blockY += 4){
+        for(int blockX = 0; blockX < size.x; blockX += 4){
+            glm::vec3 colors[16];
+            std::uint8_t alphas[16];
+            for(int y = 0; y < 4; y++){
+                for(int x = 0; x < 4; x++){
+                    // Pixels outside the image repeat the last row/column
+                    int pixelX = glm::min(blockX + x, size.x - 1), pixelY = glm::min(blockY + y, size.y - 1);
+                    const std::uint8_t* pixel = pixels + 4 * (size_t(pixelY) * size.x + pixelX);
+                    colors[4 * y + x] = glm::vec3(pixel[0], pixel[1], pixel[2]);
+                    alphas[4 * y + x] = pixel[3];
+                }
+            }
+            if(withAlpha){
+                compressAlphaBlock(alphas, output);
+                output += 8;
+            }
+            compressColorBlock(colors, output);
+            output += 8;
+        }
+    }
+}
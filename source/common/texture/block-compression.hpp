@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <cstdint>
+#include <cstddef>
+
+namespace our::block_compression {
+    // Returns the number of bytes needed to store an image of the given size as BC1 (8 bytes per 4x4 block)
+    // or BC3 (16 bytes per 4x4 block, used when the image has an alpha channel)
+    size_t getCompressedSize(glm::ivec2 size, bool withAlpha);
+
+    // Compresses RGBA pixels (8 bits per channel, rows in the same order as they would be given to glTexImage2D)
+    // into BC1 blocks (alpha is dropped) or BC3 blocks (with alpha)
+    // The output must hold "getCompressedSize(size, withAlpha)" bytes
+    // The blocks on the right and top edges are padded by repeating the last pixels
+    void compress(const std::uint8_t* pixels, glm::ivec2 size, bool withAlpha, std::uint8_t* output);
+}
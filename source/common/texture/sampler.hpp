@@ -3,6 +3,7 @@
 #include <glad/gl.h>
 #include <json/json.hpp>
 #include <glm/vec4.hpp>
+#include "../gl-state-cache.hpp"
 
 namespace our {
 
@@ -20,19 +21,21 @@ namespace our {
         // This deconstructor deletes the underlying OpenGL sampler
         ~Sampler() { 
             //TODO: (Req 6) Complete this function
+            GLStateCache::forgetSampler(name);
             glDeleteSamplers(1, &name);
          }
 
         // This method binds this sampler to the given texture unit
+        // Nothing happens if it is already bound there (see "GLStateCache")
         void bind(GLuint textureUnit) const {
             //TODO: (Req 6) Complete this function
-            glBindSampler(textureUnit, name);
+            GLStateCache::bindSampler(textureUnit, name);
         }
 
         // This static method ensures that no sampler is bound to the given texture unit
         static void unbind(GLuint textureUnit){
             //TODO: (Req 6) Complete this function
-            glBindSampler(textureUnit, 0);
+            GLStateCache::bindSampler(textureUnit, 0);
         }
 
         // This function sets a sampler paramter where the value is of type "GLint"
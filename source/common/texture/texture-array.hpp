@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glad/gl.h>
+#include "../gl-state-cache.hpp"
+
+#include <string>
+#include <unordered_map>
+
+namespace our {
+
+    // This class defines an OpenGL texture of type GL_TEXTURE_2D_ARRAY
+    // It packs many images of the same size into layers, so materials that use different images can share one bound texture
+    // Each layer can be given a name so that materials can pick their layer by name
+    class TextureArray {
+        // The OpenGL object name of this texture
+        GLuint name = 0;
+        // The layer index of each named image
+        std::unordered_map<std::string, int> layers;
+    public:
+        TextureArray() {
+            glGenTextures(1, &name);
+        }
+
+        ~TextureArray() {
+            GLStateCache::forgetTexture(name);
+            glDeleteTextures(1, &name);
+        }
+
+        GLuint getOpenGLName() const {
+            return name;
+        }
+
+        // This method binds this texture to GL_TEXTURE_2D_ARRAY (of the active texture unit)
+        void bind() const {
+            GLStateCache::bindTexture2DArray(name);
+        }
+
+        static void unbind() {
+            GLStateCache::bindTexture2DArray(0);
+        }
+
+        void setLayerName(const std::string& layerName, int layer) {
+            layers[layerName] = layer;
+        }
+
+        // Returns the index of the layer with the given name or -1 if there is no such layer
+        int getLayer(const std::string& layerName) const {
+            if(auto it = layers.find(layerName); it != layers.end()) return it->second;
+            return -1;
+        }
+
+        int getLayerCount() const {
+            return (int)layers.size();
+        }
+
+        TextureArray(const TextureArray&) = delete;
+        TextureArray& operator=(const TextureArray&) = delete;
+    };
+
+}
@@ -0,0 +1,188 @@
+#include "texture-uploader.hpp"
+#include "texture2d.hpp"
+#include "texture-utils.hpp"
+#include "../asset-cache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <vector>
+
+namespace our {
+
+    // The queue lives here (instead of the header) since "texture2d.hpp" includes the header and the image data type is not complete there
+    namespace {
+        struct UploadJob {
+            Texture2D* texture;
+            std::shared_future<texture_utils::ImageData> image;
+            bool generateMipmap;
+        };
+        // A pixel buffer that is reused for many uploads. It is free once the GPU has passed its fence
+        struct StagingBuffer {
+            GLuint buffer = 0;
+            size_t capacity = 0;
+            GLsync fence = nullptr;
+            Texture2D* texture = nullptr; // The texture that becomes resident when the fence is passed (nullptr if it was deleted)
+            size_t textureSize = 0;       // The size of the uploaded levels (reported to the "AssetCache" once resident)
+        };
+
+        constexpr size_t STAGING_BUFFER_COUNT = 3;
+
+        std::deque<UploadJob> jobs;
+        std::vector<StagingBuffer> stagingBuffers;
+
+        // Copies the image of the job into the staging buffer then starts the upload from it
+        void upload(const UploadJob& job, StagingBuffer& staging) {
+            const texture_utils::ImageData& image = job.image.get();
+            GLsizei levelCount = job.generateMipmap ? (GLsizei)image.levels.size() : 1;
+            const auto& lastLevel = image.levels[levelCount - 1];
+            size_t byteCount = lastLevel.offset + lastLevel.byteCount;
+
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+            // The buffers only grow, so after the first few textures no more allocations are needed
+            if(staging.capacity < byteCount){
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)byteCount, nullptr, GL_STREAM_DRAW);
+                staging.capacity = byteCount;
+            }
+            // The GPU is done with this buffer (its fence was passed), so there is no need for the driver to synchronize
+            void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)byteCount,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            bool staged = false;
+            if(mapped){
+                std::memcpy(mapped, image.data, byteCount);
+                // Unmapping fails if the buffer contents were lost (e.g. the display mode changed)
+                staged = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+            }
+            if(!staged) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            // Bind the texture itself since binding a non resident texture would bind the placeholder
+            GLStateCache::bindTexture2D(job.texture->getOpenGLName());
+            // A null source reads the levels from the bound PBO (at their offsets). Otherwise we upload from the client memory
+            texture_utils::uploadLevels(GL_TEXTURE_2D, image, levelCount, staged ? nullptr : image.data);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            staging.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            staging.texture = job.texture;
+            staging.textureSize = byteCount;
+        }
+    }
+
+    Texture2D* TextureUploader::enqueue(std::shared_future<texture_utils::ImageData> image, bool generateMipmap) {
+        Texture2D* texture = new Texture2D();
+        texture->setResident(false);
+        jobs.push_back(UploadJob{texture, std::move(image), generateMipmap});
+        return texture;
+    }
+
+    void TextureUploader::update() {
+        if(stagingBuffers.empty()){
+            stagingBuffers.resize(STAGING_BUFFER_COUNT);
+            for(auto& staging : stagingBuffers) glGenBuffers(1, &staging.buffer);
+        }
+
+        pollFences(false);
+
+        size_t copiedBytes = 0;
+        for(auto it = jobs.begin(); it != jobs.end();){
+            // Skip the images that are still being decoded, so one slow image doesn't hold back the rest
+            if(it->image.wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+                ++it;
+                continue;
+            }
+            const texture_utils::ImageData& image = it->image.get();
+            if(!image.isValid() || image.layers != 1){
+                // The texture stays on the placeholder (the error was already printed by the decoder)
+                it = jobs.erase(it);
+                continue;
+            }
+            const auto& lastLevel = image.levels[it->generateMipmap ? image.levels.size() - 1 : 0];
+            size_t byteCount = lastLevel.offset + lastLevel.byteCount;
+            if(copiedBytes > 0 && copiedBytes + byteCount > frameBudget) break;
+
+            auto staging = std::find_if(stagingBuffers.begin(), stagingBuffers.end(), [](const StagingBuffer& staging){ return staging.fence == nullptr; });
+            if(staging == stagingBuffers.end()) break; // All the buffers are still in use by the GPU
+
+            upload(*it, *staging);
+            copiedBytes += byteCount;
+            it = jobs.erase(it);
+        }
+    }
+
+    void TextureUploader::pollFences(bool wait) {
+        for(auto& staging : stagingBuffers){
+            if(staging.fence == nullptr) continue;
+            GLenum status;
+            if(wait){
+                do {
+                    status = glClientWaitSync(staging.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); // Wait for one second at most per try
+                } while(status == GL_TIMEOUT_EXPIRED);
+            } else {
+                status = glClientWaitSync(staging.fence, 0, 0);
+            }
+            // If the wait failed, there is nothing left to wait for, so we consider the upload done
+            if(status == GL_TIMEOUT_EXPIRED) continue;
+            glDeleteSync(staging.fence);
+            staging.fence = nullptr;
+            if(staging.texture){
+                staging.texture->setResident(true);
+                AssetCache::setMemorySize(staging.texture, staging.textureSize);
+                staging.texture = nullptr;
+            }
+        }
+    }
+
+    void TextureUploader::finish() {
+        size_t budget = frameBudget;
+        frameBudget = std::numeric_limits<size_t>::max();
+        // Each round uploads as many textures as there are free staging buffers then waits for them
+        while(getPendingCount() > 0){
+            for(auto& job : jobs) job.image.wait();
+            update();
+            pollFences(true);
+        }
+        frameBudget = budget;
+    }
+
+    void TextureUploader::cancel(const Texture2D* texture) {
+        jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [texture](const UploadJob& job){ return job.texture == texture; }), jobs.end());
+        // The upload itself can't be cancelled, but the fence must not mark the deleted texture as resident
+        for(auto& staging : stagingBuffers)
+            if(staging.texture == texture) staging.texture = nullptr;
+    }
+
+    GLuint TextureUploader::getPlaceholder() {
+        if(placeholder == 0){
+            // A single opaque black pixel: it doesn't stand out while the real textures stream in (and emits no light if used as an emissive map)
+            const std::uint8_t pixel[4] = {0, 0, 0, 255};
+            glGenTextures(1, &placeholder);
+            GLStateCache::bindTexture2D(placeholder);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        }
+        return placeholder;
+    }
+
+    size_t TextureUploader::getPendingCount() {
+        size_t count = jobs.size();
+        for(auto& staging : stagingBuffers)
+            if(staging.texture) count++;
+        return count;
+    }
+
+    void TextureUploader::clear() {
+        jobs.clear();
+        for(auto& staging : stagingBuffers){
+            if(staging.fence) glDeleteSync(staging.fence);
+            glDeleteBuffers(1, &staging.buffer);
+        }
+        stagingBuffers.clear();
+        if(placeholder != 0){
+            GLStateCache::forgetTexture(placeholder);
+            glDeleteTextures(1, &placeholder);
+            placeholder = 0;
+        }
+    }
+
+}
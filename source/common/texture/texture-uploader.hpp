@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <future>
+#include <cstddef>
+
+namespace our {
+
+    class Texture2D;
+    namespace texture_utils { struct ImageData; }
+
+    // This static class uploads textures in the background so that loading them never stalls a frame
+    // Each queued texture waits until its image is decoded, then its levels are copied into one of a few pixel buffer objects (PBOs)
+    // which are reused for the whole run, and the texture is filled from that buffer so the driver can do the transfer asynchronously.
+    // A fence is placed after the upload and the texture only becomes resident once the GPU has passed that fence.
+    // Until then, binding the texture binds a 1x1 placeholder instead.
+    // WARNING: All the functions must be called on the thread that owns the OpenGL context
+    class TextureUploader {
+        // The maximum number of bytes copied into the staging buffers per frame (at least one texture is always started per frame)
+        static inline size_t frameBudget = size_t(16) << 20;
+        static inline GLuint placeholder = 0;
+
+        // Marks the textures whose fences were passed as resident
+        static void pollFences(bool wait);
+
+    public:
+        // Returns a new texture that will receive the image once it is decoded and uploaded
+        // The texture can be bound right away (it will show the placeholder until it is resident)
+        // If the image turns out to be invalid, the texture keeps showing the placeholder
+        static Texture2D* enqueue(std::shared_future<texture_utils::ImageData> image, bool generateMipmap = true);
+
+        // Starts the uploads of the decoded images (within the frame budget) and checks which textures became resident
+        // This should be called once per frame before drawing
+        static void update();
+
+        // Waits for all the queued textures to be decoded, uploaded and resident
+        // Useful when the frame must not show any placeholder (e.g. when taking screenshots)
+        static void finish();
+
+        // Removes a texture from the queue. It is called by the texture destructor if it is not resident yet
+        static void cancel(const Texture2D* texture);
+
+        // Returns the name of the placeholder texture (it is created on the first call)
+        static GLuint getPlaceholder();
+
+        static void setFrameBudget(size_t bytes) { frameBudget = bytes; }
+        static size_t getPendingCount();
+
+        // Drops the queued uploads and deletes the staging buffers and the placeholder
+        // This should only be called at exit while the OpenGL context still exists
+        static void clear();
+    };
+
+}
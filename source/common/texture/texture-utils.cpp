@@ -3,7 +3,134 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
+#include "block-compression.hpp"
+#include "texture-uploader.hpp"
+#include "../thread-pool.hpp"
+#include "../profiler.hpp"
+
 #include <iostream>
+#include <fstream>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+
+#include <glm/common.hpp>
+
+// The header of a texture cache file (a container similar to KTX). It is followed by the data of all the mip levels
+// The cache is only meant to be read on the machine that wrote it, so the data is stored in the native layout
+static constexpr std::uint32_t MAX_TEXTURE_CACHE_LEVELS = 16; // Enough for a 32768x32768 image
+struct TextureCacheLevel {
+    std::uint32_t width, height;
+    std::uint64_t offset, byteCount; // The offset is relative to the end of the header. The level holds all the layers
+};
+struct TextureCacheHeader {
+    char magic[4];              // Always "OTEX"
+    std::uint32_t version;      // Changed whenever the format changes
+    std::uint64_t sourceHash;   // The hash of the image files from which the cache was built
+    std::uint32_t width, height;
+    std::uint32_t format;       // GL_RGBA8 or the compressed format
+    std::uint32_t levelCount;
+    std::uint32_t layerCount;   // 1 for a 2D texture, the number of layers for a texture array
+    std::uint32_t padding;
+    TextureCacheLevel levels[MAX_TEXTURE_CACHE_LEVELS];
+};
+
+static constexpr std::uint32_t TEXTURE_CACHE_VERSION = 2;
+
+// Read by the worker threads that decode the images
+static std::atomic<bool> compressionEnabled{false};
+
+void our::texture_utils::setCompressionEnabled(bool enabled)
+{
+    compressionEnabled = enabled;
+}
+
+// Reads the mip chain from the cache file if it exists, was built from sources with the given hash, has the given number of layers
+// and is compressed only if compression is wanted. Returns false if the cache is missing, stale or invalid
+static bool loadTextureCache(const std::string &cachePath, std::uint64_t sourceHash, std::uint32_t layerCount, bool compressed, our::texture_utils::ImageData &image)
+{
+    auto file = std::make_unique<our::MappedFile>(cachePath);
+    if (!file->isOpen() || file->getSize() < sizeof(TextureCacheHeader))
+        return false;
+    TextureCacheHeader header;
+    std::memcpy(&header, file->getData(), sizeof(header));
+    if (std::memcmp(header.magic, "OTEX", 4) != 0 || header.version != TEXTURE_CACHE_VERSION || header.sourceHash != sourceHash ||
+        (header.format != GL_RGBA8) != compressed || header.layerCount != layerCount ||
+        header.levelCount == 0 || header.levelCount > MAX_TEXTURE_CACHE_LEVELS)
+        return false;
+    size_t dataSize = file->getSize() - sizeof(TextureCacheHeader);
+    image.levels.clear();
+    for (std::uint32_t level = 0; level < header.levelCount; level++)
+    {
+        const TextureCacheLevel &cached = header.levels[level];
+        if (cached.offset > dataSize || cached.byteCount > dataSize - cached.offset)
+            return false;
+        image.levels.push_back({glm::ivec2(cached.width, cached.height), (size_t)cached.offset, (size_t)cached.byteCount});
+    }
+    // The levels will be uploaded straight from the mapped memory
+    image.size = glm::ivec2(header.width, header.height);
+    image.format = header.format;
+    image.layers = (int)header.layerCount;
+    image.data = file->getData() + sizeof(TextureCacheHeader);
+    image.cache = std::move(file);
+    return true;
+}
+
+// Writes the mip chain to the cache file. Failing to write the cache is not an error (the image will be decoded again next time)
+static void writeTextureCache(const std::string &cachePath, std::uint64_t sourceHash, const our::texture_utils::ImageData &image)
+{
+    TextureCacheHeader header = {};
+    std::memcpy(header.magic, "OTEX", 4);
+    header.version = TEXTURE_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.width = (std::uint32_t)image.size.x;
+    header.height = (std::uint32_t)image.size.y;
+    header.format = (std::uint32_t)image.format;
+    header.levelCount = (std::uint32_t)image.levels.size();
+    header.layerCount = (std::uint32_t)image.layers;
+    for (size_t level = 0; level < image.levels.size(); level++)
+    {
+        const auto &source = image.levels[level];
+        header.levels[level] = {(std::uint32_t)source.size.x, (std::uint32_t)source.size.y, source.offset, source.byteCount};
+    }
+    // We write to a temporary file then rename it, so a crash while writing never leaves a broken cache behind
+    std::string temporaryPath = cachePath + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return;
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(image.data), image.storage.size());
+        if (!file)
+            return;
+    }
+    std::remove(cachePath.c_str());
+    if (std::rename(temporaryPath.c_str(), cachePath.c_str()) != 0)
+        std::remove(temporaryPath.c_str());
+}
+
+// Creates the next mip level by averaging each 2x2 block of pixels (the last row/column is repeated for odd sizes)
+static std::vector<std::uint8_t> downsample(const std::vector<std::uint8_t> &pixels, glm::ivec2 size, glm::ivec2 nextSize)
+{
+    std::vector<std::uint8_t> result(size_t(nextSize.x) * nextSize.y * 4);
+    for (int y = 0; y < nextSize.y; y++)
+    {
+        int y0 = std::min(2 * y, size.y - 1), y1 = std::min(2 * y + 1, size.y - 1);
+        for (int x = 0; x < nextSize.x; x++)
+        {
+            int x0 = std::min(2 * x, size.x - 1), x1 = std::min(2 * x + 1, size.x - 1);
+            for (int channel = 0; channel < 4; channel++)
+            {
+                int sum = pixels[4 * (size_t(y0) * size.x + x0) + channel] + pixels[4 * (size_t(y0) * size.x + x1) + channel] +
+                          pixels[4 * (size_t(y1) * size.x + x0) + channel] + pixels[4 * (size_t(y1) * size.x + x1) + channel];
+                result[4 * (size_t(y) * nextSize.x + x) + channel] = std::uint8_t((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
 
 our::Texture2D *our::texture_utils::empty(GLenum format, glm::ivec2 size)
 {
@@ -18,13 +145,48 @@ our::Texture2D *our::texture_utils::empty(GLenum format, glm::ivec2 size)
     return texture;
 }
 
-our::Texture2D *our::texture_utils::loadImage(const std::string &filename, bool generate_mipmap)
+// Resizes an image to the given size. The image is first halved while it is at least twice as big as the result
+// (so that no pixel is skipped) then bilinearly filtered to the exact size
+static std::vector<std::uint8_t> resize(std::vector<std::uint8_t> pixels, glm::ivec2 size, glm::ivec2 newSize)
+{
+    while (size.x >= 2 * newSize.x && size.y >= 2 * newSize.y)
+    {
+        glm::ivec2 halfSize = size / 2;
+        pixels = downsample(pixels, size, halfSize);
+        size = halfSize;
+    }
+    if (size == newSize)
+        return pixels;
+    std::vector<std::uint8_t> result(size_t(newSize.x) * newSize.y * 4);
+    for (int y = 0; y < newSize.y; y++)
+    {
+        float sourceY = glm::clamp((y + 0.5f) * size.y / newSize.y - 0.5f, 0.0f, float(size.y - 1));
+        int y0 = int(sourceY), y1 = std::min(y0 + 1, size.y - 1);
+        float fy = sourceY - y0;
+        for (int x = 0; x < newSize.x; x++)
+        {
+            float sourceX = glm::clamp((x + 0.5f) * size.x / newSize.x - 0.5f, 0.0f, float(size.x - 1));
+            int x0 = int(sourceX), x1 = std::min(x0 + 1, size.x - 1);
+            float fx = sourceX - x0;
+            for (int channel = 0; channel < 4; channel++)
+            {
+                float top = glm::mix(float(pixels[4 * (size_t(y0) * size.x + x0) + channel]), float(pixels[4 * (size_t(y0) * size.x + x1) + channel]), fx);
+                float bottom = glm::mix(float(pixels[4 * (size_t(y1) * size.x + x0) + channel]), float(pixels[4 * (size_t(y1) * size.x + x1) + channel]), fx);
+                result[4 * (size_t(y) * newSize.x + x) + channel] = std::uint8_t(glm::mix(top, bottom, fy) + 0.5f);
+            }
+        }
+    }
+    return result;
+}
+
+// Decodes an image from memory to RGBA pixels. Returns false if the image could not be decoded
+static bool decodePixels(const our::MappedFile &source, std::vector<std::uint8_t> &pixels, glm::ivec2 &size)
 {
-    glm::ivec2 size;
     int channels;
     // Since OpenGL puts the texture origin at the bottom left while images typically has the origin at the top left,
     // We need to till stb to flip images vertically after loading them
-    stbi_set_flip_vertically_on_load(true);
+    // We use the thread local version of the flag since images may be decoded on multiple threads at the same time
+    stbi_set_flip_vertically_on_load_thread(true);
     // Load image data and retrieve width, height and number of channels in the image
     // The last argument is the number of channels we want and it can have the following values:
     //- 0: Keep number of channels the same as in the image file
@@ -33,24 +195,212 @@ our::Texture2D *our::texture_utils::loadImage(const std::string &filename, bool
     //- 3: RGB
     //- 4: RGB and Alpha (RGBA)
     // Note: channels (the 4th argument) always returns the original number of channels in the file
-    unsigned char *pixels = stbi_load(filename.c_str(), &size.x, &size.y, &channels, 4);
-    if (pixels == nullptr)
+    unsigned char *decoded = stbi_load_from_memory(source.getData(), (int)source.getSize(), &size.x, &size.y, &channels, 4);
+    if (decoded == nullptr)
+        return false;
+    pixels.assign(decoded, decoded + size_t(size.x) * size.y * 4);
+    stbi_image_free(decoded);
+    return true;
+}
+
+// Generates the whole mip chain (down to 1x1) of each layer on the CPU instead of calling glGenerateMipmap after uploading,
+// compresses the levels if needed and stores them in "image"
+// Each level holds all the layers one after the other (the layout expected by glTexSubImage3D)
+static void buildImage(std::vector<std::vector<std::uint8_t>> layers, glm::ivec2 size, bool compress, our::texture_utils::ImageData &image)
+{
+    // Images without any transparent pixel are compressed to BC1 (half the size of BC3)
+    bool withAlpha = false;
+    for (const auto &pixels : layers)
+        for (size_t index = 3; index < pixels.size() && !withAlpha; index += 4)
+            withAlpha = pixels[index] != 255;
+
+    image.size = size;
+    image.layers = (int)layers.size();
+    image.format = compress ? (withAlpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT) : GL_RGBA8;
+    image.levels.clear();
+
+    std::vector<glm::ivec2> sizes = {size};
+    while ((sizes.back().x > 1 || sizes.back().y > 1) && sizes.size() < MAX_TEXTURE_CACHE_LEVELS)
+        sizes.push_back(glm::max(sizes.back() / 2, glm::ivec2(1)));
+    size_t offset = 0;
+    for (auto levelSize : sizes)
+    {
+        size_t layerBytes = compress ? our::block_compression::getCompressedSize(levelSize, withAlpha) : size_t(levelSize.x) * levelSize.y * 4;
+        image.levels.push_back({levelSize, offset, layerBytes * layers.size()});
+        offset += layerBytes * layers.size();
+    }
+    image.storage.resize(offset);
+
+    for (size_t level = 0; level < sizes.size(); level++)
+    {
+        size_t layerBytes = image.levels[level].byteCount / layers.size();
+        for (size_t layer = 0; layer < layers.size(); layer++)
+        {
+            if (level > 0)
+                layers[layer] = downsample(layers[layer], sizes[level - 1], sizes[level]);
+            std::uint8_t *destination = image.storage.data() + image.levels[level].offset + layer * layerBytes;
+            if (compress)
+                our::block_compression::compress(layers[layer].data(), sizes[level], withAlpha, destination);
+            else
+                std::memcpy(destination, layers[layer].data(), layerBytes);
+        }
+    }
+    image.data = image.storage.data();
+}
+
+static bool isCompressionWanted()
+{
+    return compressionEnabled && GLAD_GL_EXT_texture_compression_s3tc;
+}
+
+our::texture_utils::ImageData our::texture_utils::decodeImage(const std::string &filename)
+{
+    OUR_PROFILE_SCOPE("Decode image");
+    ImageData image;
+    // The image file is mapped once: its content is hashed to validate the cache, then decoded from memory if needed
+    our::MappedFile source(filename);
+    if (!source.isOpen())
     {
         std::cerr << "Failed to load image: " << filename << std::endl;
-        return nullptr;
+        return image;
+    }
+    std::uint64_t sourceHash = our::hashBytes(source.getData(), source.getSize());
+    bool compress = isCompressionWanted();
+    std::string cachePath = filename + ".texcache";
+    if (loadTextureCache(cachePath, sourceHash, 1, compress, image))
+        return image;
+
+    std::vector<std::uint8_t> pixels;
+    glm::ivec2 size;
+    if (!decodePixels(source, pixels, size))
+    {
+        std::cerr << "Failed to load image: " << filename << std::endl;
+        return image;
+    }
+    buildImage({std::move(pixels)}, size, compress, image);
+    writeTextureCache(cachePath, sourceHash, image);
+    return image;
+}
+
+our::texture_utils::ImageData our::texture_utils::decodeImageArray(const std::string &cachePath, const std::vector<std::string> &filenames, glm::ivec2 size)
+{
+    OUR_PROFILE_SCOPE("Decode image array");
+    ImageData image;
+    if (filenames.empty() || size.x <= 0 || size.y <= 0)
+        return image;
+    // The cache depends on the content & order of the images and on the layer size
+    std::vector<std::unique_ptr<our::MappedFile>> sources;
+    std::uint64_t sourceHash = our::hashBytes(&size, sizeof(size));
+    for (const auto &filename : filenames)
+    {
+        auto source = std::make_unique<our::MappedFile>(filename);
+        if (!source->isOpen())
+        {
+            std::cerr << "Failed to load image: " << filename << std::endl;
+            return image;
+        }
+        sourceHash = our::hashBytes(source->getData(), source->getSize(), sourceHash);
+        sources.push_back(std::move(source));
+    }
+    bool compress = isCompressionWanted();
+    if (loadTextureCache(cachePath, sourceHash, (std::uint32_t)filenames.size(), compress, image))
+        return image;
+
+    // All the layers of an array have the same size, so the images are resized to the layer size
+    std::vector<std::vector<std::uint8_t>> layers;
+    for (size_t index = 0; index < sources.size(); index++)
+    {
+        std::vector<std::uint8_t> pixels;
+        glm::ivec2 imageSize;
+        if (!decodePixels(*sources[index], pixels, imageSize))
+        {
+            std::cerr << "Failed to load image: " << filenames[index] << std::endl;
+            return image;
+        }
+        layers.push_back(resize(std::move(pixels), imageSize, size));
+    }
+    sources.clear();
+    buildImage(std::move(layers), size, compress, image);
+    writeTextureCache(cachePath, sourceHash, image);
+    return image;
+}
+
+void our::texture_utils::uploadLevels(GLenum target, const ImageData &image, GLsizei levelCount, const std::uint8_t *source)
+{
+    bool isArray = target == GL_TEXTURE_2D_ARRAY;
+    // Immutable storage allocates the whole mip chain at once, so the driver doesn't need to check the texture completeness later
+    bool immutable = GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_storage;
+    if (immutable)
+    {
+        if (isArray)
+            glTexStorage3D(target, levelCount, image.format, image.size.x, image.size.y, image.layers);
+        else
+            glTexStorage2D(target, levelCount, image.format, image.size.x, image.size.y);
     }
+    else
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+    for (GLsizei level = 0; level < levelCount; level++)
+    {
+        const auto &imageLevel = image.levels[level];
+        // With a pixel buffer bound, OpenGL takes the offset in the buffer in place of the pointer
+        const void *bytes = source ? static_cast<const void *>(source + imageLevel.offset) : reinterpret_cast<const void *>(std::uintptr_t(imageLevel.offset));
+        GLsizei width = imageLevel.size.x, height = imageLevel.size.y, byteCount = (GLsizei)imageLevel.byteCount;
+        if (image.isCompressed())
+        {
+            if (isArray && immutable)
+                glCompressedTexSubImage3D(target, level, 0, 0, 0, width, height, image.layers, image.format, byteCount, bytes);
+            else if (isArray)
+                glCompressedTexImage3D(target, level, image.format, width, height, image.layers, 0, byteCount, bytes);
+            else if (immutable)
+                glCompressedTexSubImage2D(target, level, 0, 0, width, height, image.format, byteCount, bytes);
+            else
+                glCompressedTexImage2D(target, level, image.format, width, height, 0, byteCount, bytes);
+        }
+        else
+        {
+            if (isArray && immutable)
+                glTexSubImage3D(target, level, 0, 0, 0, width, height, image.layers, GL_RGBA, GL_UNSIGNED_BYTE, bytes);
+            else if (isArray)
+                glTexImage3D(target, level, GL_RGBA8, width, height, image.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, bytes);
+            else if (immutable)
+                glTexSubImage2D(target, level, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, bytes);
+            else
+                glTexImage2D(target, level, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, bytes);
+        }
+    }
+}
+
+our::Texture2D *our::texture_utils::uploadImage(const ImageData &image, bool generate_mipmap)
+{
+    if (!image.isValid() || image.layers != 1)
+        return nullptr;
     // Create a texture
     our::Texture2D *texture = new our::Texture2D();
     // Bind the texture such that we upload the image data to its storage
     // TODO: (Req 5) Finish this function to fill the texture with the data found in "pixels"
     texture->bind();
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-
-    if (generate_mipmap)
-    {
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
+    uploadLevels(GL_TEXTURE_2D, image, generate_mipmap ? (GLsizei)image.levels.size() : 1, image.data);
+    return texture;
+}
 
-    stbi_image_free(pixels); // Free image data after uploading to GPU
+our::TextureArray *our::texture_utils::uploadImageArray(const ImageData &image)
+{
+    if (!image.isValid())
+        return nullptr;
+    our::TextureArray *texture = new our::TextureArray();
+    texture->bind();
+    uploadLevels(GL_TEXTURE_2D_ARRAY, image, (GLsizei)image.levels.size(), image.data);
     return texture;
-}
\ No newline at end of file
+}
+
+our::Texture2D *our::texture_utils::loadImage(const std::string &filename, bool generate_mipmap)
+{
+    return uploadImage(decodeImage(filename), generate_mipmap);
+}
+
+our::Texture2D *our::texture_utils::loadImageAsync(const std::string &filename, bool generate_mipmap)
+{
+    auto image = ThreadPool::getShared().submit([filename]() { return decodeImage(filename); }).share();
+    return TextureUploader::enqueue(std::move(image), generate_mipmap);
+}
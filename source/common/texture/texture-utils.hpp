@@ -1,14 +1,69 @@
 #pragma once
 
 #include "texture2d.hpp"
+#include "texture-array.hpp"
+#include "../mapped-file.hpp"
 #include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
 
 #include <glad/gl.h>
 #include <glm/vec2.hpp>
 
 namespace our::texture_utils {
+    // The location of a mip level inside "ImageData::data" (a level holds all the layers one after the other)
+    struct ImageLevel {
+        glm::ivec2 size;
+        size_t offset, byteCount;
+    };
+
+    // A decoded image with its whole mip chain, ready to be uploaded
+    // The format is either GL_RGBA8 (4 bytes per pixel) or one of the S3TC compressed formats
+    // The data either lives in "storage" (if the image was decoded) or in the mapped texture cache file
+    struct ImageData {
+        glm::ivec2 size = {0, 0};
+        int layers = 1;
+        GLenum format = GL_RGBA8;
+        std::vector<ImageLevel> levels;
+        std::vector<std::uint8_t> storage;
+        std::unique_ptr<MappedFile> cache;
+        const std::uint8_t* data = nullptr;
+
+        bool isValid() const { return data != nullptr; }
+        bool isCompressed() const { return format != GL_RGBA8; }
+    };
+
+    // Enables compressing the textures to BC1 (opaque images) or BC3 (images with alpha) when the driver supports S3TC
+    // It is disabled by default and must be set before any texture is loaded
+    void setCompressionEnabled(bool enabled);
+
     // This function create an empty texture with a specific format (useful for framebuffers)
     Texture2D* empty(GLenum format, glm::ivec2 size);
-    // This function loads an image and sends its data to the given Texture2D 
+    // This function reads an image file and returns its mip chain without calling OpenGL, so it can run on any thread
+    // The first time an image is loaded, its mip chain (compressed if enabled) is written to a cache file next to the image
+    // so the next loads only map the cache file instead of decoding the image and generating the mipmaps
+    // If the image could not be loaded, the returned data is not valid
+    ImageData decodeImage(const std::string& filename);
+    // This function reads many images (without calling OpenGL), resizes them to the given size and packs them as the layers of a texture array
+    // The packed mip chains are cached in the given file, so the next loads only map it
+    // If any image could not be loaded, the returned data is not valid
+    ImageData decodeImageArray(const std::string& cachePath, const std::vector<std::string>& filenames, glm::ivec2 size);
+    // This function allocates the storage of the texture bound to "target" and uploads the first "levelCount" levels of the image into it
+    // The levels are read from "source" + their offset. If "source" is null, the levels are read from the pixel buffer bound to
+    // GL_PIXEL_UNPACK_BUFFER, at their offset in that buffer
+    // For GL_TEXTURE_2D, the image must have a single layer
+    void uploadLevels(GLenum target, const ImageData& image, GLsizei levelCount, const std::uint8_t* source);
+    // This function creates a texture with immutable storage from decoded image data (it must be called on the thread that owns the OpenGL context)
+    // If "generate_mipmap" is false, only the first level is uploaded
+    // Returns nullptr if the image data is not valid
+    Texture2D* uploadImage(const ImageData& image, bool generate_mipmap = true);
+    // This function creates a texture array (with all the mip levels) from the data returned by "decodeImageArray"
+    // Returns nullptr if the image data is not valid
+    TextureArray* uploadImageArray(const ImageData& image);
+    // This function loads an image and sends its data to the given Texture2D
     Texture2D* loadImage(const std::string& filename, bool generate_mipmap = true);
-}
\ No newline at end of file
+    // This function returns a texture right away, then decodes the image on the shared thread pool and uploads it through the "TextureUploader"
+    // The texture can be used immediately: it shows a placeholder until its data is resident
+    Texture2D* loadImageAsync(const std::string& filename, bool generate_mipmap = true);
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <glad/gl.h>
+#include "../gl-state-cache.hpp"
+#include "texture-uploader.hpp"
 
 namespace our {
 
@@ -8,6 +10,8 @@ namespace our {
     class Texture2D {
         // The OpenGL object name of this texture 
         GLuint name = 0;
+        // False while the data of the texture is still being uploaded by the "TextureUploader"
+        bool resident = true;
     public:
         // This constructor creates an OpenGL texture and saves its object name in the member variable "name" 
         Texture2D() {
@@ -18,24 +22,37 @@ namespace our {
         // This deconstructor deletes the underlying OpenGL texture
         ~Texture2D() { 
             //TODO: (Req 5) Complete this function
+            if(!resident) TextureUploader::cancel(this);
+            GLStateCache::forgetTexture(name);
             glDeleteTextures(1, &name);
         }
 
         // Get the internal OpenGL name of the texture which is useful for use with framebuffers
-        GLuint getOpenGLName() {
+        GLuint getOpenGLName() const {
             return name;
         }
 
-        // This method binds this texture to GL_TEXTURE_2D
+        // Returns false while the texture data is still being uploaded
+        bool isResident() const {
+            return resident;
+        }
+
+        void setResident(bool value) {
+            resident = value;
+        }
+
+        // This method binds this texture to GL_TEXTURE_2D (of the active texture unit)
+        // Until the texture is resident, the placeholder texture is bound instead
+        // Nothing happens if it is already bound there (see "GLStateCache")
         void bind() const {
             //TODO: (Req 5) Complete this function
-            glBindTexture(GL_TEXTURE_2D, name);
+            GLStateCache::bindTexture2D(resident ? name : TextureUploader::getPlaceholder());
         }
 
         // This static method ensures that no texture is bound to GL_TEXTURE_2D
         static void unbind(){
             //TODO: (Req 5) Complete this function
-            glBindTexture(GL_TEXTURE_2D, 0);
+            GLStateCache::bindTexture2D(0);
         }
 
         Texture2D(const Texture2D&) = delete;
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <queue>
+#include <vector>
+#include <type_traits>
+
+namespace our {
+
+    // A fixed set of worker threads that run the submitted jobs in submission order
+    // WARNING: The jobs run without an OpenGL context, so they must never call OpenGL functions.
+    // Any OpenGL work must be done by the main thread after the job's future is ready.
+    class ThreadPool {
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> jobs;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping = false;
+
+        void work() {
+            while(true){
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    condition.wait(lock, [this]{ return stopping || !jobs.empty(); });
+                    if(jobs.empty()) return; // Only happens when stopping
+                    job = std::move(jobs.front());
+                    jobs.pop();
+                }
+                job();
+            }
+        }
+
+    public:
+        // If no thread count is given, we keep one hardware thread free for the main thread
+        explicit ThreadPool(unsigned threadCount = 0) {
+            if(threadCount == 0){
+                unsigned hardwareThreads = std::thread::hardware_concurrency();
+                threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+            }
+            for(unsigned index = 0; index < threadCount; index++)
+                workers.emplace_back([this]{ work(); });
+        }
+
+        // Finishes the remaining jobs then joins the workers
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            condition.notify_all();
+            for(auto& worker : workers) worker.join();
+        }
+
+        // Queues a job and returns a future that receives its result (or the exception it throws)
+        template<typename Function>
+        auto submit(Function&& function) -> std::future<std::invoke_result_t<std::decay_t<Function>>> {
+            using Result = std::invoke_result_t<std::decay_t<Function>>;
+            // std::function must be copyable, so the (move-only) packaged task is held by a shared pointer
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+            std::future<Result> future = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.emplace([task]{ (*task)(); });
+            }
+            condition.notify_one();
+            return future;
+        }
+
+        size_t getThreadCount() const { return workers.size(); }
+
+        // A pool shared by the whole application. It is created on first use.
+        static ThreadPool& getShared() {
+            static ThreadPool pool;
+            return pool;
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+    };
+
+}
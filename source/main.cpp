@@ -1,5 +1,7 @@
 #include <iostream>
 #include <fstream>
+#include <filesystem>
+#include <unordered_set>
 #include <flags/flags.h>
 #include <json/json.hpp>
 
@@ -41,6 +43,28 @@ int main(int argc, char** argv) {
     nlohmann::json app_config = nlohmann::json::parse(file_in, nullptr, true, true);
     file_in.close();
 
+    // A config can extend another config by naming it in "base" (e.g. the benchmark configs extend "../game.jsonc")
+    // The base path is relative to the config that names it, and its own values are merged over the values of the base config
+    std::filesystem::path current_path = config_path;
+    std::unordered_set<std::string> visited_paths = { std::filesystem::weakly_canonical(current_path).string() };
+    while(app_config.contains("base")){
+        std::filesystem::path base_path = current_path.parent_path() / app_config["base"].get<std::string>();
+        app_config.erase("base");
+        if(!visited_paths.insert(std::filesystem::weakly_canonical(base_path).string()).second){
+            std::cerr << "The \"base\" configs loop back to: " << base_path.string() << std::endl;
+            return -1;
+        }
+        current_path = base_path;
+        std::ifstream base_in(base_path);
+        if(!base_in){
+            std::cerr << "Couldn't open file: " << base_path.string() << std::endl;
+            return -1;
+        }
+        nlohmann::json base_config = nlohmann::json::parse(base_in, nullptr, true, true);
+        base_config.merge_patch(app_config);
+        app_config = std::move(base_config);
+    }
+
     // Create the application
     our::Application app(app_config);
     
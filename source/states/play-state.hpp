@@ -6,7 +6,9 @@
 #include <systems/forward-renderer.hpp>
 #include <systems/free-camera-controller.hpp>
 #include <systems/movement.hpp>
+#include <systems/collision.hpp>
 #include <asset-loader.hpp>
+#include <profiler.hpp>
 #include <irrKlang.h>
 using namespace irrklang;
 
@@ -17,6 +19,7 @@ class Playstate: public our::State {
     our::ForwardRenderer renderer;
     our::FreeCameraControllerSystem cameraController;
     our::MovementSystem movementSystem;
+    our::CollisionSystem collisionSystem;
     ISoundEngine * sound; 
 
     void onInitialize() override {
@@ -120,14 +123,34 @@ class Playstate: public our::State {
 
         
     }
+    // The game logic runs at a fixed rate so that its cost doesn't grow with the frame rate
+    // and fast objects (logs and cars) can't skip over the frog when a frame is slow
+    void onFixedUpdate(double fixedDeltaTime) override {
+        if (getApp()->getGameState() == our::GameState::PAUSE) return;
+        // The transforms before this step are kept to draw the frames between this step and the next one
+        world.savePreviousTransforms();
+        // Here, we just run a bunch of systems to control the world logic
+        {
+            OUR_PROFILE_SCOPE("Movement");
+            movementSystem.update(&world, (float)fixedDeltaTime);
+        }
+        {
+            OUR_PROFILE_SCOPE("Collision");
+            collisionSystem.update(&world);
+        }
+        {
+            OUR_PROFILE_SCOPE("Camera controller");
+            cameraController.update(&world, (float)fixedDeltaTime,&renderer,&collisionSystem);
+        }
+    }
+
     void onDraw(double deltaTime) override {
         our::GameState state = getApp()->getGameState();
         if (state != our::GameState::PAUSE){
-        // Here, we just run a bunch of systems to control the world logic
-        movementSystem.update(&world, (float)deltaTime);
-        cameraController.update(&world, (float)deltaTime,&renderer);
-        // And finally we use the renderer system to draw the scene
-        renderer.render(&world);
+        // Looking around follows the mouse every frame
+        cameraController.updateLook(&world);
+        // And finally we use the renderer system to draw the scene between the last two fixed steps
+        renderer.render(&world, (float)getApp()->getInterpolationFactor());
         }
         // Get a reference to the keyboard object
         auto& keyboard = getApp()->getKeyboard();
@@ -152,7 +175,7 @@ class Playstate: public our::State {
         cameraController.exit();
         // Clear the world
         world.clear();
-        // and we delete all the loaded assets to free memory on the RAM and the VRAM
+        // and we give up the loaded assets (the shaders, textures and meshes stay in the asset cache for the next time we play)
         our::clearAllAssets();
 
         sound->drop(); // remove audio
@@ -6,6 +6,7 @@
 #include <texture/texture-utils.hpp>
 #include <material/material.hpp>
 #include <mesh/mesh.hpp>
+#include <asset-cache.hpp>
 #include <irrKlang.h>
 using namespace irrklang;
 
@@ -53,23 +54,18 @@ class winMenuState: public our::State {
     void onInitialize() override {
         // First, we create a material for the menu's background
         menuMaterial = new our::TexturedMaterial();
-        // Here, we load the shader that will be used to draw the background
-        menuMaterial->shader = new our::ShaderProgram();
-        menuMaterial->shader->attach("assets/shaders/textured.vert", GL_VERTEX_SHADER);
-        menuMaterial->shader->attach("assets/shaders/textured.frag", GL_FRAGMENT_SHADER);
-        menuMaterial->shader->link();
-        // Then we load the menu texture
-        menuMaterial->texture = our::texture_utils::loadImage("assets/textures/win_menu.png");
+        // Here, we get the shader that will be used to draw the background
+        // The shaders, the texture and the rectangle come from the asset cache, so they are only loaded the first time a menu is entered
+        menuMaterial->shader = our::acquireShader("assets/shaders/textured.vert", "assets/shaders/textured.frag");
+        // Then we get the menu texture
+        menuMaterial->texture = our::acquireTexture("assets/textures/win_menu.png");
         // Initially, the menu material will be black, then it will fade in
         menuMaterial->tint = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
 
         // Second, we create a material to highlight the hovered buttons
         highlightMaterial = new our::TintedMaterial();
         // Since the highlight is not textured, we used the tinted material shaders
-        highlightMaterial->shader = new our::ShaderProgram();
-        highlightMaterial->shader->attach("assets/shaders/tinted.vert", GL_VERTEX_SHADER);
-        highlightMaterial->shader->attach("assets/shaders/tinted.frag", GL_FRAGMENT_SHADER);
-        highlightMaterial->shader->link();
+        highlightMaterial->shader = our::acquireShader("assets/shaders/tinted.vert", "assets/shaders/tinted.frag");
         // The tint is white since we will subtract the background color from it to create a negative effect.
         highlightMaterial->tint = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
         // To create a negative effect, we enable blending, set the equation to be subtract,
@@ -82,13 +78,15 @@ class winMenuState: public our::State {
         // Then we create a rectangle whose top-left corner is at the origin and its size is 1x1.
         // Note that the texture coordinates at the origin is (0.0, 1.0) since we will use the 
         // projection matrix to make the origin at the the top-left corner of the screen.
-        rectangle = new our::Mesh({
-            {{0.0f, 0.0f, 0.0f}, {255, 255, 255, 255}, {0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
-            {{1.0f, 0.0f, 0.0f}, {255, 255, 255, 255}, {1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
-            {{1.0f, 1.0f, 0.0f}, {255, 255, 255, 255}, {1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
-            {{0.0f, 1.0f, 0.0f}, {255, 255, 255, 255}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
-        },{
-            0, 1, 2, 2, 3, 0,
+        rectangle = our::AssetCache::acquire<our::Mesh>("mesh:menu-rectangle", [](){
+            return new our::Mesh({
+                {{0.0f, 0.0f, 0.0f}, {255, 255, 255, 255}, {0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+                {{1.0f, 0.0f, 0.0f}, {255, 255, 255, 255}, {1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+                {{1.0f, 1.0f, 0.0f}, {255, 255, 255, 255}, {1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+                {{0.0f, 1.0f, 0.0f}, {255, 255, 255, 255}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+            },{
+                0, 1, 2, 2, 3, 0,
+            });
         });
 
         // Reset the time elapsed since the state is entered.
@@ -192,12 +190,12 @@ class winMenuState: public our::State {
     }
 
     void onDestroy() override {
-        // Delete all the allocated resources
-        delete rectangle;
-        delete menuMaterial->texture;
-        delete menuMaterial->shader;
+        // Delete all the allocated resources (the cached ones are released so that the next state can reuse them)
+        our::AssetCache::release(rectangle);
+        our::AssetCache::release(menuMaterial->texture);
+        our::AssetCache::release(menuMaterial->shader);
         delete menuMaterial;
-        delete highlightMaterial->shader;
+        our::AssetCache::release(highlightMaterial->shader);
         delete highlightMaterial;
         sound->drop(); // remove audio
     }